@@ -53,13 +53,19 @@ http_header_t headers[] = {
      
      _myID = System.deviceID();
      
+     _useCollector = false;
+     _collectorPort = ENVPACKET_COLLECTOR_PORT;
+     _collectorMisses = 0;
+     _directPostsLeft = 0;
+     _bootId = HAL_RNG_GetRandomNumber();
+     _sequence = 0;
+     _payloadTicks = 0;
+     
  };
  
- EmonLink::EmonLink(String host) : _hostName(host)
+ EmonLink::EmonLink(String host) : EmonLink()
  {
-        EmonLink();
-        //_hostPort = 5000;
-        //_myID = System.deviceID();
+        _hostName = host;
  };
  
  bool EmonLink::isProvisioned(void)
@@ -77,6 +83,11 @@ http_header_t headers[] = {
      return _emonName;
  }
  
+ bool EmonLink::usingCollector(void)
+ {
+     return _useCollector;
+ }
+ 
  String EmonLink::getDeviceName(void)
  {
      return _deviceName;
@@ -90,9 +101,6 @@ http_header_t headers[] = {
 // Post data to EmonCMS: external temp if we have a DS18 sensor
 bool EmonLink::postExternalSensorData(float temp)
 {
-    // Build a JSON payload
-    JsonWriterStatic<512> jw;
-    char trimmedValue[32];
     bool stat = true;
     
     // Sometimes, the sensor returns "NAN" for a reading.
@@ -100,35 +108,8 @@ bool EmonLink::postExternalSensorData(float temp)
     
     if( temp != NAN ) 
     {
-    
-        {
-            JsonWriterAutoObject obj(&jw);
-            
-    		// Add various types of data
-    		snprintf(trimmedValue,sizeof(trimmedValue)-1,"%.2f", temp);
-    		if( strncmp(trimmedValue,"nan", 3) != 0) {
-    		    jw.insertKeyValue("extTemp", trimmedValue);
-    		}
-        }
-        
-        
-        http_request_t request; 
-        http_response_t response;  
-        
-        // EmonCMS post to the node on port 80
-        request.hostname = _hostName;
-        request.port = 80;
-        request.path = String::format("/input/post?node=%s&fulljson=%s&apikey=%s", _deviceName.c_str(),jw.getBuffer(), _apiKey.c_str());
-        
-        http.get(request, response, headers);   
-        
-        stat = (response.status == 200);
-        
-        // Log this via the hardcoded webhook, if debugging is turned on
-        if( _debugLogging)
-        {
-            Particle.publish("sensDebugLog", request.path, PRIVATE);    
-        }
+        const char *keys[] = { "extTemp" };
+        stat = postReadings(keys, &temp, 1);
     }
     
     return stat;
@@ -137,9 +118,6 @@ bool EmonLink::postExternalSensorData(float temp)
 // Post data to EmonCMS: internal data from the BME280, if one is fitted
 bool EmonLink::postInternalSensorData(float temp, float pressure, float humidity)
 {
-    // Build a JSON payload
-    JsonWriterStatic<512> jw;
-    char trimmedValue[32];
     bool stat = true;
     
     // Sometimes, the sensor returns "NAN" for a reading.
@@ -147,51 +125,223 @@ bool EmonLink::postInternalSensorData(float temp, float pressure, float humidity
     
     if( temp != NAN && pressure != NAN && humidity != NAN ) 
     {
+        const char *keys[] = { "encTemp", "pressure", "humidity" };
+        float readings[] = { temp, pressure, humidity };
+        stat = postReadings(keys, readings, 3);
+    }
     
+    return stat;
+}
+ 
+ uint32_t EmonLink::payloadTicks(void)
+ {
+     return _payloadTicks;
+ }
+ 
+ bool EmonLink::hasReadings(const float *readings, size_t count)
+ {
+    for (size_t i = 0; i < count; i++)
+    {
+        if( !isnan(readings[i]))
         {
-            JsonWriterAutoObject obj(&jw);
-            
-    		// Add various types of data
-    		snprintf(trimmedValue,sizeof(trimmedValue)-1,"%.2f", temp);
-    		if( strncmp(trimmedValue,"nan", 3) != 0) {
-    		    jw.insertKeyValue("encTemp", trimmedValue);
-    		}
-    		
-    		snprintf(trimmedValue,sizeof(trimmedValue)-1, "%.2f", pressure);
-    		if( strncmp(trimmedValue,"nan", 3) != 0) {
-    		    jw.insertKeyValue("pressure", trimmedValue);
-    		}    		
-    		
-    		snprintf(trimmedValue,sizeof(trimmedValue)-1, "%.2f", humidity);
-    		if( strncmp(trimmedValue,"nan", 3) != 0) {
-    		    jw.insertKeyValue("humidity", trimmedValue);
-    		} 
+            return true;
         }
+    }
+    return false;
+ }
+ 
+ // Private functions
+ // Post one set of readings, keys[i] naming readings[i]: to the collector if we're using one,
+ // otherwise (or if the collector has just been dropped) as one JSON object straight to emonCMS
+ bool EmonLink::postReadings(const char *const *keys, const float *readings, size_t count)
+ {
+    _payloadTicks = 0;
+    
+    // No sensor gave us anything (say a fixed sensor build whose sensors haven't started): nothing to post, nothing failed
+    if( !hasReadings(readings, count))
+    {
+        return true;
+    }
+    
+    if( _useCollector )
+    {
+        bool posted = postToCollector(keys, readings, count);
+        if( posted || _useCollector)
+        {
+            return posted;
+        }
+        // The collector has stopped answering: post this one directly
+    }
+    
+    // Build a JSON payload
+    uint32_t buildStartTicks = System.ticks();
+    JsonWriterStatic<512> jw;
+    char trimmedValue[32];
+    
+    {
+        JsonWriterAutoObject obj(&jw);
         
+        for (size_t i = 0; i < count; i++)
+        {
+            // Sometimes, the sensor returns "NAN" for a reading: just leave that one out
+            snprintf(trimmedValue,sizeof(trimmedValue)-1,"%.2f", readings[i]);
+            if( strncmp(trimmedValue,"nan", 3) != 0) {
+                jw.insertKeyValue(keys[i], trimmedValue);
+            }
+        }
+    }
+    _payloadTicks += System.ticks() - buildStartTicks;
+    
+    return postToEmonCMS(jw.getBuffer());
+ }
+ 
+ // Post one JSON object of readings to EmonCMS, as an input for this node
+ bool EmonLink::postToEmonCMS(String jsonPayload)
+ {
+    http_request_t request; 
+    http_response_t response;  
+    
+    // EmonCMS post to the node on port 80
+    request.hostname = _hostName;
+    request.port = 80;
+    request.path = String::format("/input/post?node=%s&fulljson=%s&apikey=%s", _deviceName.c_str(), jsonPayload.c_str(), _apiKey.c_str());
+    
+    http.get(request, response, headers);   
+    
+    // Log this via the hardcoded webhook, if debugging is turned on
+    if( _debugLogging)
+    {
+        Particle.publish("sensDebugLog", request.path, PRIVATE);    
+    }
+    
+    // If we gave up on the collector, see if it's back
+    if( _collectorHost.length() > 0 && !_useCollector && --_directPostsLeft <= 0)
+    {
+        startCollector();
+    }
+    
+    return (response.status == 200);
+ }
+ 
+ // Send readings to the LAN collector as one datagram, which forwards them to emonCMS for us
+ // True once the collector has acknowledged it
+ bool EmonLink::postToCollector(const char *const *keys, const float *readings, size_t count)
+ {
+    uint32_t buildStartTicks = System.ticks();
+    EnvPacket packet;
+    uint8_t buffer[ENVPACKET_MAX_LEN];
+    
+    if( !envPacketParseDeviceId(_myID.c_str(), packet.deviceId))
+    {
+        return false;
+    }
+    
+    packet.bootId = _bootId;
+    packet.count = 0;
+    
+    // The collector posts under our cloud name, as postToEmonCMS() does
+    strncpy(packet.name, _deviceName.c_str(), ENVPACKET_MAX_NAME_LEN);
+    packet.name[ENVPACKET_MAX_NAME_LEN] = '\0';
+    
+    for (size_t i = 0; i < count && packet.count < ENVPACKET_MAX_READINGS; i++)
+    {
+        // Leave out NAN readings, and anything the collector wouldn't know the name of
+        uint8_t key = envPacketKeyId(keys[i]);
+        if( isnan(readings[i]) || key == ENVPACKET_KEY_UNKNOWN)
+        {
+            continue;
+        }
         
-        http_request_t request; 
-        http_response_t response;  
-        
-        // EmonCMS post to the node on port 80
-        request.hostname = _hostName;
-        request.port = 80;
-        request.path = String::format("/input/post?node=%s&fulljson=%s&apikey=%s", _deviceName.c_str(),jw.getBuffer(), _apiKey.c_str());
-        
-        http.get(request, response, headers);   
+        packet.readings[packet.count].key = key;
+        packet.readings[packet.count].value = envPacketToFixed(readings[i]);
+        packet.count++;
+    }
+    
+    // An empty datagram would tell the collector nothing: don't send one, or count it for or against the collector
+    if( packet.count == 0)
+    {
+        return true;
+    }
+    
+    packet.sequence = _sequence++;
+    size_t len = envPacketEncode(packet, buffer, sizeof(buffer));
+    _payloadTicks += System.ticks() - buildStartTicks;
+    bool acked = false;
+    
+    for (int i = 0; i < COLLECTOR_SEND_ATTEMPTS && !acked; i++)
+    {
+        if( _udp.sendPacket(buffer, len, _collectorIP, _collectorPort) == (int)len)
+        {
+            acked = waitForCollectorAck(packet.sequence);
+        }
+    }
+    
+    if( _debugLogging)
+    {
+        Particle.publish("sensDebugLog", String::format("collector seq %lu, %u readings, %s", (unsigned long)packet.sequence, packet.count, acked ? "acked" : "no ack"), PRIVATE);
+    }
+    
+    if( acked)
+    {
+        _collectorMisses = 0;
+    }
+    else if( ++_collectorMisses >= COLLECTOR_MAX_MISSES)
+    {
+        // The collector has gone (or moved, or forgotten us): post directly for a while
+        Particle.publish("DEBUG","Collector " + _collectorHost + " not answering. Posting to emonCMS directly");
+        _useCollector = false;
+        _directPostsLeft = COLLECTOR_RETRY_POSTS;
+    }
+    
+    return acked;
+ }
+ 
+ // The collector acks with the highest sequence number it has from this boot
+ // Anything older is a late ack for an earlier post: skip it
+ bool EmonLink::waitForCollectorAck(uint32_t sequence)
+ {
+    uint8_t buffer[ENVPACKET_ACK_LEN + 1];
+    unsigned long start = millis();
+    
+    while( millis() - start < COLLECTOR_ACK_TIMEOUT_MS)
+    {
+        if( _udp.parsePacket() <= 0)
+        {
+            delay(5);
+            continue;
+        }
         
-        stat = (response.status == 200);
+        uint32_t bootId;
+        uint32_t acked;
+        int len = _udp.read(buffer, sizeof(buffer));
         
-        // Log this via the hardcoded webhook, if debugging is turned on
-        if( _debugLogging)
+        if( len > 0 && envPacketDecodeAck(buffer, len, bootId, acked) && bootId == _bootId && (int32_t)(acked - sequence) >= 0)
         {
-            Particle.publish("sensDebugLog", request.path, PRIVATE);    
+            return true;
         }
     }
     
-    return stat;
-}
+    return false;
+ }
+ 
+ // Resolve the collector (again: it may have moved since we last looked) and open our socket
+ bool EmonLink::startCollector(void)
+ {
+    _useCollector = false;
+    _collectorMisses = 0;
+    _directPostsLeft = COLLECTOR_RETRY_POSTS;
+    
+    _collectorIP = WiFi.resolve(_collectorHost);
+    _udp.stop();
+    
+    if( _collectorIP && _udp.begin(COLLECTOR_LOCAL_PORT))
+    {
+        _useCollector = true;
+    }
+    
+    return _useCollector;
+ }
  
- // Private functions
  // Call the API server on the emonCMS node to get the API key and other data
  bool EmonLink::getProvisioningData(void)
  {
@@ -238,6 +388,24 @@ bool EmonLink::postInternalSensorData(float temp, float pressure, float humidity
         Particle.publish("DEBUG","Node name not returned by emonCMS API. Check provisioning protocol");
         return false;
     }   
+    
+    // Optional: the provisioning service can point us at a collector on the LAN
+    // If so, readings go there over UDP and it batches them up for emonCMS
+    // Reprovisioning resolves the collector again, in case it has moved
+    _useCollector = false;
+    _collectorHost = "";
+    
+    if( parser.getOuterValueByKey("collector", _collectorHost) && _collectorHost.length() > 0)
+    {
+        _collectorPort = ENVPACKET_COLLECTOR_PORT;
+        parser.getOuterValueByKey("collectorPort", _collectorPort);
+        
+        if( !startCollector())
+        {
+            // Not fatal: we just post to emonCMS directly, and try it again later
+            Particle.publish("DEBUG","Collector " + _collectorHost + " not reachable. Posting to emonCMS directly");
+        }
+    }
 
     
     // All good, we should be good to go for publishing
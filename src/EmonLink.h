@@ -32,15 +32,28 @@
  */
  
  #ifndef emonlink_h
- #define emonline_h
+ #define emonlink_h
  
  #include <Particle.h>
  #include <HttpClient.h>
  #include <JsonParserGeneratorRK.h>
  #include <math.h>
  
+ #include "EnvPacket.h"
+ 
  // If we fail to report this number of times, we'll try to reprovision
  #define MAX_REPORT_RETRIES 1000
+ 
+ // Collector mode: the collector acknowledges each datagram. Without an ack in COLLECTOR_ACK_TIMEOUT_MS we send again,
+ // up to COLLECTOR_SEND_ATTEMPTS times (the collector drops any repeats), and then count the post as failed.
+ #define COLLECTOR_SEND_ATTEMPTS 2
+ #define COLLECTOR_ACK_TIMEOUT_MS 250
+ #define COLLECTOR_LOCAL_PORT 5006
+ 
+ // After this many failed posts in a row we stop using the collector and post to emonCMS directly,
+ // then give the collector another go (resolving it again) after COLLECTOR_RETRY_POSTS direct posts
+ #define COLLECTOR_MAX_MISSES 3
+ #define COLLECTOR_RETRY_POSTS 120
 
  
  class EmonLink
@@ -58,9 +71,23 @@
         String getDeviceName(void); // OUr name in the Particle console
         String getEmonName(void);
         
+        bool usingCollector(void);  // Readings go to a LAN collector, rather than straight to emonCMS
+        
         bool postExternalSensorData(float temp);
         bool postInternalSensorData(float temp, float pressure, float humidity);
         
+        // Post a complete set of readings as one input. Used by fixed sensor set builds.
+        // Keys is the compile-time key list for the configuration: Keys::size readings, Keys::key(i) names reading i
+        template <typename Keys>
+        bool postSensorData(const float (&readings)[Keys::size]);
+        
+        // How long the last post took to build its payload (JSON or datagram), in System.ticks(). Network waits
+        // are left out: they'd swamp the difference between builds.
+        uint32_t payloadTicks(void);
+        
+        // False if every reading is NAN: there's nothing to post, and the posting functions send nothing for it
+        static bool hasReadings(const float *readings, size_t count);
+        
         void setDebugLogging(bool);
         
     private:
@@ -70,7 +97,11 @@
         String formatExternalTemp(float temp);
         String formatInternalSensorData(float temp, float pressure, float humidity);
         
+        bool postReadings(const char *const *keys, const float *readings, size_t count);
         bool postToEmonCMS(String jsonPayload);
+        bool postToCollector(const char *const *keys, const float *readings, size_t count);
+        bool waitForCollectorAck(uint32_t sequence);
+        bool startCollector(void);
         
         bool _isProvisioned;
         bool _debugLogging;
@@ -83,8 +114,33 @@
         String _deviceName;     // The name of this device in the particle cloud
         String _emonName;       // Name returned by emonCMS 
         
+        // Collector mode: only set up if the provisioning service tells us about a collector
+        bool _useCollector;
+        String _collectorHost;
+        IPAddress _collectorIP;
+        int _collectorPort;
+        int _collectorMisses;
+        int _directPostsLeft;   // Until we try the collector again
+        UDP _udp;
+        uint32_t _bootId;
+        uint32_t _sequence;
+        
+        uint32_t _payloadTicks;
+        
  }; 
  
+template <typename Keys>
+bool EmonLink::postSensorData(const float (&readings)[Keys::size])
+{
+    const char *keys[Keys::size];
+    
+    for (size_t i = 0; i < Keys::size; i++)
+    {
+        keys[i] = Keys::key(i);
+    }
+    
+    return postReadings(keys, readings, Keys::size);
+}
  
  #endif
  
\ No newline at end of file
@@ -30,6 +30,9 @@
  */
 
 #include "EnvNode.h"
+
+// A fixed sensor set build is entirely in FixedEnvNode.h: don't link either driver here
+#ifndef ENVNODE_SENSORS
         
 DS18B20 extDS18(dsData, true);
 Adafruit_BME280 bmeSensor;        
@@ -128,3 +131,9 @@ bool EnvNode::ds18Found(void)
     return _ds18Found;
 }
 
+bool EnvNode::allSensorsFound(void)
+{
+    return _bmeFound && _ds18Found;
+}
+
+#endif
@@ -47,6 +47,18 @@ const int16_t dsData = D6;
 
 #define MAX_DS18_RETRY  4
 
+#include "EnvNodeConfig.h"
+
+#ifdef ENVNODE_SENSORS
+
+// Sensor set fixed at compile time
+#include "FixedEnvNode.h"
+
+typedef EnvNode<ENVNODE_SENSORS> FixedEnvNode;
+
+#else
+
+// Runtime detection: probe for both sensors, and report whichever we find
 class EnvNode
 {
         public:
@@ -62,6 +74,7 @@ class EnvNode
             
             bool bmeFound(void);
             bool ds18Found(void);
+            bool allSensorsFound(void);
         
         private:
         
@@ -72,4 +85,6 @@ class EnvNode
             
 };
 
+#endif
+
 #endif
\ No newline at end of file
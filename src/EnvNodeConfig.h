@@ -0,0 +1,48 @@
+/*
+ * This app is the emoncms node for inside/outside environment monitors
+ *
+ * Build-time sensor configuration for the node
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef envnodeconfig_h
+#define envnodeconfig_h
+
+// By default a node probes for a BME280 and a DS18B20 when it boots, and keeps retrying until it finds them.
+// That build works on every node in the fleet, but links both drivers and checks for each sensor on every read.
+//
+// Each node model has a fixed, known sensor set, so it can instead be built for exactly that set:
+// define ENVNODE_SENSORS to the list of sensors fitted (see FixedEnvNode.h) and the unused driver
+// and all the detection logic compile away. Readings are then posted to emonCMS as a single input.
+//
+// Pick at most one:
+//
+// #define ENVNODE_SENSORS Bme280Sensor                     // Indoor node: enclosure temp, pressure, humidity
+// #define ENVNODE_SENSORS Ds18b20Sensor                    // Probe-only node: external temp
+// #define ENVNODE_SENSORS Bme280Sensor, Ds18b20Sensor      // Full node: both sensors
+
+#endif
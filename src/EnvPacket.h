@@ -0,0 +1,270 @@
+/*
+ * This app is the emoncms node for inside/outside environment monitors
+ *
+ * Compact binary datagram sent from a node to the LAN collector, instead of posting to emonCMS directly
+ * Shared by the node firmware and the collector (tools/collector), so keep it plain C++ with no Particle dependencies
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef envpacket_h
+#define envpacket_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Datagram layout, multi-byte fields big endian
+//
+//   0  magic 'E' 'N'
+//   2  version
+//   3  number of readings, n
+//   4  device ID: the 24 hex digit Particle device ID, as 12 bytes
+//  16  boot ID: random per boot, so the collector can tell a restarted node from a replayed datagram.
+//      32 bits, so a restarted node all but never draws the ID it had before and has its readings taken for repeats.
+//  20  sequence number, per boot
+//  24  length of the node name, m (up to 31)
+//  25  node name: the Particle cloud name, the same emonCMS node a direct post goes to. m = 0 if not known yet.
+//  25+m  n readings of { key ID, value in hundredths as int32 }
+//
+// The collector acknowledges each datagram from a device it knows, to the address it came from:
+//
+//   0  magic 'E' 'A'
+//   2  version
+//   3  0
+//   4  boot ID, as received
+//   8  highest sequence number the collector has accepted for that boot
+
+#define ENVPACKET_VERSION           3
+#define ENVPACKET_HEADER_LEN        24
+#define ENVPACKET_MAX_NAME_LEN      31
+#define ENVPACKET_READING_LEN       5
+#define ENVPACKET_MAX_READINGS      8
+#define ENVPACKET_MAX_LEN           (ENVPACKET_HEADER_LEN + 1 + ENVPACKET_MAX_NAME_LEN + ENVPACKET_MAX_READINGS * ENVPACKET_READING_LEN)
+#define ENVPACKET_DEVICE_ID_LEN     12
+#define ENVPACKET_ACK_LEN           12
+
+// Default UDP port the collector listens on
+#define ENVPACKET_COLLECTOR_PORT    5005
+
+// Reading keys are sent as an ID: these are the emonCMS input names they stand for
+#define ENVPACKET_KEY_UNKNOWN       0xff
+
+static const char *const envPacketKeys[] = { "encTemp", "pressure", "humidity", "extTemp" };
+static const uint8_t envPacketNumKeys = sizeof(envPacketKeys) / sizeof(envPacketKeys[0]);
+
+struct EnvReading
+{
+    uint8_t key;
+    int32_t value;      // hundredths
+};
+
+struct EnvPacket
+{
+    uint8_t  deviceId[ENVPACKET_DEVICE_ID_LEN];
+    uint32_t bootId;
+    uint32_t sequence;
+    char     name[ENVPACKET_MAX_NAME_LEN + 1];
+    uint8_t  count;
+    EnvReading readings[ENVPACKET_MAX_READINGS];
+};
+
+// Key ID for an emonCMS input name, or ENVPACKET_KEY_UNKNOWN
+static inline uint8_t envPacketKeyId(const char *name)
+{
+    for (uint8_t i = 0; i < envPacketNumKeys; i++)
+    {
+        if (strcmp(envPacketKeys[i], name) == 0) {
+            return i;
+        }
+    }
+    return ENVPACKET_KEY_UNKNOWN;
+}
+
+// emonCMS input name for a key ID, or NULL
+static inline const char *envPacketKeyName(uint8_t id)
+{
+    return id < envPacketNumKeys ? envPacketKeys[id] : NULL;
+}
+
+static inline int32_t envPacketToFixed(float value)
+{
+    return (int32_t)(value * 100.0f + (value < 0 ? -0.5f : 0.5f));
+}
+
+static inline double envPacketFromFixed(int32_t value)
+{
+    return value / 100.0;
+}
+
+// Device ID: 24 hex digits <-> 12 bytes. Parsing fails on anything else.
+static inline bool envPacketParseDeviceId(const char *hex, uint8_t *deviceId)
+{
+    if (strlen(hex) != 2 * ENVPACKET_DEVICE_ID_LEN) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < 2 * ENVPACKET_DEVICE_ID_LEN; i++)
+    {
+        char c = hex[i];
+        uint8_t nibble;
+        
+        if (c >= '0' && c <= '9') {
+            nibble = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            nibble = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            nibble = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        
+        if (i % 2 == 0) {
+            deviceId[i / 2] = nibble << 4;
+        } else {
+            deviceId[i / 2] |= nibble;
+        }
+    }
+    return true;
+}
+
+// hex needs room for 25 chars. Lower case, as Particle reports device IDs.
+static inline void envPacketFormatDeviceId(const uint8_t *deviceId, char *hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    
+    for (size_t i = 0; i < ENVPACKET_DEVICE_ID_LEN; i++)
+    {
+        hex[2 * i] = digits[deviceId[i] >> 4];
+        hex[2 * i + 1] = digits[deviceId[i] & 0x0f];
+    }
+    hex[2 * ENVPACKET_DEVICE_ID_LEN] = '\0';
+}
+
+static inline void envPacketPut32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static inline uint32_t envPacketGet32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Returns the datagram length, or 0 if the buffer is too small, the name too long or there are too many readings
+static inline size_t envPacketEncode(const EnvPacket &packet, uint8_t *buffer, size_t bufferLen)
+{
+    size_t nameLen = strnlen(packet.name, sizeof(packet.name));
+    size_t len = ENVPACKET_HEADER_LEN + 1 + nameLen + packet.count * ENVPACKET_READING_LEN;
+    
+    if (nameLen > ENVPACKET_MAX_NAME_LEN || packet.count > ENVPACKET_MAX_READINGS || bufferLen < len) {
+        return 0;
+    }
+    
+    buffer[0] = 'E';
+    buffer[1] = 'N';
+    buffer[2] = ENVPACKET_VERSION;
+    buffer[3] = packet.count;
+    memcpy(buffer + 4, packet.deviceId, ENVPACKET_DEVICE_ID_LEN);
+    envPacketPut32(buffer + 16, packet.bootId);
+    envPacketPut32(buffer + 20, packet.sequence);
+    buffer[24] = nameLen;
+    memcpy(buffer + 25, packet.name, nameLen);
+    
+    uint8_t *p = buffer + ENVPACKET_HEADER_LEN + 1 + nameLen;
+    for (uint8_t i = 0; i < packet.count; i++)
+    {
+        p[0] = packet.readings[i].key;
+        envPacketPut32(p + 1, (uint32_t)packet.readings[i].value);
+        p += ENVPACKET_READING_LEN;
+    }
+    
+    return len;
+}
+
+// Returns false for anything that isn't a well formed datagram of our version
+static inline bool envPacketDecode(const uint8_t *buffer, size_t len, EnvPacket &packet)
+{
+    if (len < ENVPACKET_HEADER_LEN + 1 || buffer[0] != 'E' || buffer[1] != 'N' || buffer[2] != ENVPACKET_VERSION) {
+        return false;
+    }
+    
+    size_t nameLen = buffer[24];
+    packet.count = buffer[3];
+    if (nameLen > ENVPACKET_MAX_NAME_LEN || packet.count > ENVPACKET_MAX_READINGS ||
+        len != ENVPACKET_HEADER_LEN + 1 + nameLen + (size_t)packet.count * ENVPACKET_READING_LEN) {
+        return false;
+    }
+    
+    memcpy(packet.deviceId, buffer + 4, ENVPACKET_DEVICE_ID_LEN);
+    packet.bootId = envPacketGet32(buffer + 16);
+    packet.sequence = envPacketGet32(buffer + 20);
+    memcpy(packet.name, buffer + 25, nameLen);
+    packet.name[nameLen] = '\0';
+    
+    const uint8_t *p = buffer + ENVPACKET_HEADER_LEN + 1 + nameLen;
+    for (uint8_t i = 0; i < packet.count; i++)
+    {
+        packet.readings[i].key = p[0];
+        packet.readings[i].value = (int32_t)envPacketGet32(p + 1);
+        p += ENVPACKET_READING_LEN;
+    }
+    
+    return true;
+}
+
+// Returns the acknowledgement length, or 0 if the buffer is too small
+static inline size_t envPacketEncodeAck(uint32_t bootId, uint32_t sequence, uint8_t *buffer, size_t bufferLen)
+{
+    if (bufferLen < ENVPACKET_ACK_LEN) {
+        return 0;
+    }
+    
+    buffer[0] = 'E';
+    buffer[1] = 'A';
+    buffer[2] = ENVPACKET_VERSION;
+    buffer[3] = 0;
+    envPacketPut32(buffer + 4, bootId);
+    envPacketPut32(buffer + 8, sequence);
+    
+    return ENVPACKET_ACK_LEN;
+}
+
+static inline bool envPacketDecodeAck(const uint8_t *buffer, size_t len, uint32_t &bootId, uint32_t &sequence)
+{
+    if (len != ENVPACKET_ACK_LEN || buffer[0] != 'E' || buffer[1] != 'A' || buffer[2] != ENVPACKET_VERSION) {
+        return false;
+    }
+    
+    bootId = envPacketGet32(buffer + 4);
+    sequence = envPacketGet32(buffer + 8);
+    return true;
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * This app is the emoncms node for inside/outside environment monitors
+ *
+ * Fixed-configuration EnvNode: the sensor set is a compile-time parameter
+ * Only the drivers for sensors actually fitted are built in, and there is no search for sensors that aren't fitted.
+ * A fitted sensor is still started at runtime (for the DS18B20, a bus search to check it's there), and retried until it starts
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef fixedenvnode_h
+#define fixedenvnode_h
+
+// Included by EnvNode.h when ENVNODE_SENSORS is defined: don't include directly
+
+#include <math.h>
+#include <type_traits>
+
+// The sensors a node can be built with.
+// Each one knows how to start itself, how many readings it produces, and the emonCMS key for each reading.
+// begin() returns whether the sensor started: it can be called again until it does, and does nothing after that.
+// read() fills numReadings values, in key order, or NAN for each one if the sensor has not started.
+
+class Bme280Sensor
+{
+        public:
+            static constexpr size_t numReadings = 3;
+            
+            static constexpr const char *key(size_t i)
+            {
+                return i == 0 ? "encTemp" : (i == 1 ? "pressure" : "humidity");
+            }
+            
+            bool begin(void)
+            {
+                if (!_started) {
+                    _started = _bme.begin();
+                }
+                return _started;
+            }
+            
+            bool started(void) const
+            {
+                return _started;
+            }
+            
+            // Temperature in C, pressure in hPa, humidity in %
+            void read(float *readings)
+            {
+                if (!_started) {
+                    readings[0] = readings[1] = readings[2] = NAN;
+                    return;
+                }
+                
+                readings[0] = _bme.readTemperature();
+                readings[1] = _bme.readPressure()/100.0F;
+                readings[2] = _bme.readHumidity();
+            }
+            
+        private:
+        
+            Adafruit_BME280 _bme;
+            bool _started = false;
+};
+
+class Ds18b20Sensor
+{
+        public:
+            Ds18b20Sensor(void) : _ds18(dsData, true) {}
+            
+            static constexpr size_t numReadings = 1;
+            
+            static constexpr const char *key(size_t)
+            {
+                return "extTemp";
+            }
+            
+            // Single drop bus, so reads don't need the address: the search just checks the sensor is there
+            bool begin(void)
+            {
+                if (!_started) {
+                    _started = _ds18.search();
+                }
+                return _started;
+            }
+            
+            bool started(void) const
+            {
+                return _started;
+            }
+            
+            void read(float *readings)
+            {
+                if (!_started) {
+                    readings[0] = NAN;
+                    return;
+                }
+                
+                float temp;
+                int   i = 0;
+            
+                do 
+                {
+                    temp = _ds18.getTemperature();
+                } while (!_ds18.crcCheck() && MAX_DS18_RETRY > i++);
+            
+                if (i >= MAX_DS18_RETRY) {
+                    // No valid reading .. report an impossible value, the same as the runtime build
+                    temp = 255.0;
+                }
+                
+                readings[0] = temp;
+            }
+            
+        private:
+        
+            DS18B20 _ds18;
+            bool _started = false;
+};
+
+// Compile-time list of the readings produced by a set of sensors
+// size is the total number of readings, key(i) the emonCMS key of reading i
+// This is also the key list EmonLink::postSensorData() uses for the configuration
+template <typename... Sensors>
+struct SensorList;
+
+template <>
+struct SensorList<>
+{
+    static constexpr size_t size = 0;
+    
+    static constexpr const char *key(size_t)
+    {
+        return "";
+    }
+    
+    template <typename Sensor>
+    static constexpr bool contains(void)
+    {
+        return false;
+    }
+    
+    template <typename Sensor>
+    static constexpr size_t offsetOf(void)
+    {
+        return 0;
+    }
+};
+
+template <typename First, typename... Rest>
+struct SensorList<First, Rest...>
+{
+    static constexpr size_t size = First::numReadings + SensorList<Rest...>::size;
+    
+    static constexpr const char *key(size_t i)
+    {
+        return i < First::numReadings ? First::key(i) : SensorList<Rest...>::key(i - First::numReadings);
+    }
+    
+    template <typename Sensor>
+    static constexpr bool contains(void)
+    {
+        return std::is_same<Sensor, First>::value || SensorList<Rest...>::template contains<Sensor>();
+    }
+    
+    // Index of the first reading of Sensor
+    template <typename Sensor>
+    static constexpr size_t offsetOf(void)
+    {
+        return std::is_same<Sensor, First>::value ? 0 : First::numReadings + SensorList<Rest...>::template offsetOf<Sensor>();
+    }
+};
+
+template <typename... Sensors>
+class EnvNode : private Sensors...
+{
+        public:
+            typedef SensorList<Sensors...> Keys;
+            
+            static_assert(Keys::size > 0, "An EnvNode needs at least one sensor");
+            
+            EnvNode(void)
+            {
+                for (size_t i = 0; i < Keys::size; i++) {
+                    _readings[i] = 255.0;
+                }
+            }
+            
+            // The sensors are known to be fitted, so there is nothing to search for: just start them.
+            // A sensor that fails to start reads as NAN; call again (from the sensor init timer) to retry it.
+            void initSensors(void)
+            {
+                int started[] = { 0, (Sensors::begin(), 0)... };
+                (void)started;
+            }
+            
+            bool allSensorsFound(void) const
+            {
+                bool started[] = { true, static_cast<const Sensors &>(*this).started()... };
+                for (bool s : started) {
+                    if (!s) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            
+            // Read every sensor once. The getters below, and readings(), return these values until the next call.
+            void readSensors(void)
+            {
+                int read[] = { 0, (Sensors::read(_readings + Keys::template offsetOf<Sensors>()), 0)... };
+                (void)read;
+            }
+            
+            // All readings, in Keys order
+            const float (&readings(void) const)[Keys::size]
+            {
+                return _readings;
+            }
+            
+            float getEnclosureTemp(void) { return reading(HasBme(), Keys::template offsetOf<Bme280Sensor>()); }
+            float getPressure(void) { return reading(HasBme(), Keys::template offsetOf<Bme280Sensor>() + 1); }
+            float getHumidity(void) { return reading(HasBme(), Keys::template offsetOf<Bme280Sensor>() + 2); }
+            
+            float getExternalTemp(void) { return reading(HasDs18(), Keys::template offsetOf<Ds18b20Sensor>()); }
+            
+            // Fitted in this build and started
+            bool bmeFound(void) const { return started<Bme280Sensor>(HasBme()); }
+            bool ds18Found(void) const { return started<Ds18b20Sensor>(HasDs18()); }
+            
+        private:
+        
+            typedef std::integral_constant<bool, Keys::template contains<Bme280Sensor>()> HasBme;
+            typedef std::integral_constant<bool, Keys::template contains<Ds18b20Sensor>()> HasDs18;
+            
+            float reading(std::true_type, size_t i) { return _readings[i]; }
+            
+            template <typename Sensor>
+            bool started(std::true_type) const { return static_cast<const Sensor &>(*this).started(); }
+            
+            template <typename Sensor>
+            bool started(std::false_type) const { return false; }
+            
+            // Sensor not in this build: same impossible answer as the runtime build gives for a missing sensor
+            float reading(std::false_type, size_t) { return 255.0; }
+            
+            float _readings[Keys::size];
+};
+
+#endif
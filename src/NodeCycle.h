@@ -0,0 +1,252 @@
+/*
+ * This app is the emoncms node for inside/outside environment monitors
+ *
+ * The node's measure / post / reprovision cycle, as run from loop()
+ * Shared by the sketch and the host load generator (tools/loadgen), so what the load generator measures is what the nodes do
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef nodecycle_h
+#define nodecycle_h
+
+#include "EmonLink.h"
+#include "EnvNode.h"
+
+// The caller owns the timers: each step says whether its timer should stop (or the provisioning timer start again)
+
+// What the cycle keeps between runs. The readings are also the sketch's console variables.
+struct NodeState
+{
+    NodeState(void) : temperature(255.0), enclosureTemperature(255.0), pressure(0.0), humidity(255.0),
+                      reportFailureCount(0), debugLogging(false) {}
+    
+    double temperature;
+    double enclosureTemperature;
+    double pressure;
+    double humidity;
+    
+    int  reportFailureCount;
+    bool debugLogging;
+};
+
+// Told about each reading set the cycle posts, or can't post. The sketch doesn't care;
+// the load generator passes its own, with the same members, to time the posts.
+struct NodeCycleObserver
+{
+    void postStarted(void) {}
+    void postFinished(bool) {}
+    void postSkipped(void) {}           // Not provisioned yet: nothing posted
+};
+
+// Reading sets posted per measurement
+template <typename Node>
+int nodePostsPerCycle(Node &envNode)
+{
+#ifdef ENVNODE_SENSORS
+    // One, once any sensor has started: until then there's nothing to post
+    return (envNode.bmeFound() || envNode.ds18Found()) ? 1 : 0;
+#else
+    return envNode.bmeFound() + envNode.ds18Found();
+#endif
+}
+
+template <typename Node>
+void nodePublishSensors(Node &envNode)
+{
+    String bmeMsg = "I will ";
+    if( !envNode.bmeFound())
+    {
+        bmeMsg.concat("NOT currently be able to ");
+    }
+    bmeMsg.concat("report BME280 sensor data");
+    Particle.publish("INFO",bmeMsg);
+        
+    String ds18Msg = "I will ";
+    if( !envNode.ds18Found())
+    {
+        ds18Msg.concat("NOT currently be able to ");    
+    }
+    ds18Msg.concat("report DS18B20 sensor data");
+    Particle.publish("INFO",ds18Msg);
+}
+
+// Sensor init timer: true once every sensor is found, and the timer can stop
+template <typename Node>
+bool nodeSearchSensors(Node &envNode)
+{
+    Particle.publish("INFO", "Retrying searching for sensors");
+    
+    envNode.initSensors();
+    nodePublishSensors(envNode);
+    
+    return envNode.allSensorsFound();
+}
+
+// Provisioning timer: true once provisioned, and the timer can stop.
+// To reprovision a node, force a reboot via the Particle console (or fail enough posts).
+template <typename Node>
+bool nodeProvision(Node &envNode, EmonLink &emonLink)
+{
+    if( !emonLink.attemptProvisioning())
+    {
+        Particle.publish("DEBUG","Not provisioned to emonpi. Will retry ...");
+        return false;
+    }
+    
+    Particle.publish("INFO","Provisioned and ready to talk to emonpi");
+    if( emonLink.usingCollector())
+    {
+        Particle.publish("INFO","Readings go via the LAN collector");
+    }
+    
+    // What will we publish?
+    nodePublishSensors(envNode);
+    return true;
+}
+
+template <typename Observer>
+void nodeCountPost(NodeState &state, Observer &observer, bool ok)
+{
+    observer.postFinished(ok);
+    
+    // Somethihg wrong: emonCMS node might be offline
+    // We start a counter - if it fails enough times, we'll trigger a reprovisioning
+    state.reportFailureCount = ok ? 0 : state.reportFailureCount + 1;
+}
+
+// Measurement timer: read the sensors, publish and post the readings.
+// True if posts have failed often enough that the provisioning timer should start again.
+template <typename Node, typename Observer>
+bool nodeMeasure(Node &envNode, EmonLink &emonLink, NodeState &state, Observer &observer)
+{
+    // For comparing builds, time just the work that differs between them: reading the sensors and building the
+    // payloads. Publishing and posting (HTTP, or the collector's ack waits) take far longer, and are left out.
+    uint32_t workTicks = 0;
+    uint32_t startTicks = System.ticks();
+    
+#ifdef ENVNODE_SENSORS
+    // Fixed sensor set: read every sensor once, the getters below return these readings
+    envNode.readSensors();
+#endif
+    workTicks += System.ticks() - startTicks;
+    
+    // We do two separate data posts to emonCMS to make this code very simple
+    // (except in a fixed sensor set build, which posts everything once, below)
+    if( envNode.bmeFound() )
+    {
+        startTicks = System.ticks();
+        state.enclosureTemperature = envNode.getEnclosureTemp();
+        state.pressure = envNode.getPressure();
+        state.humidity = envNode.getHumidity();
+        workTicks += System.ticks() - startTicks;
+    
+        // Publish on the event stream as an attidition way of getting them
+        Particle.publish("ENCTEMP", String::format("%.2f", state.enclosureTemperature));
+        Particle.publish("PRESSURE", String::format("%.2f", state.pressure));
+        Particle.publish("HUMIDITY", String::format("%.2f", state.humidity));
+        
+#ifndef ENVNODE_SENSORS
+        // Post to emoncms
+        if( emonLink.isProvisioned())
+        {
+            observer.postStarted();
+            nodeCountPost(state, observer, emonLink.postInternalSensorData(state.enclosureTemperature, state.pressure, state.humidity));
+            workTicks += emonLink.payloadTicks();
+        }
+        else
+        {
+            observer.postSkipped();
+        }
+#endif
+    }
+
+    if( envNode.ds18Found() )
+    {
+        startTicks = System.ticks();
+        state.temperature = envNode.getExternalTemp();
+        workTicks += System.ticks() - startTicks;
+        
+        // Publish on the event stream
+        Particle.publish("EXTTEMP", String::format("%.2f", state.temperature));   
+        
+#ifndef ENVNODE_SENSORS
+        // Post to emoncms
+        if( emonLink.isProvisioned())
+        {
+            observer.postStarted();
+            nodeCountPost(state, observer, emonLink.postExternalSensorData(state.temperature));
+            workTicks += emonLink.payloadTicks();
+        }
+        else
+        {
+            observer.postSkipped();
+        }
+#endif
+    }
+    
+#ifdef ENVNODE_SENSORS
+    // Post to emoncms: all readings in one go, keyed by this configuration's key list.
+    // Until a sensor has started every reading is NAN: like a runtime build with no sensors found, post nothing.
+    if( EmonLink::hasReadings(envNode.readings(), Node::Keys::size))
+    {
+        if( emonLink.isProvisioned())
+        {
+            observer.postStarted();
+            nodeCountPost(state, observer, emonLink.postSensorData<typename Node::Keys>(envNode.readings()));
+            workTicks += emonLink.payloadTicks();
+        }
+        else
+        {
+            observer.postSkipped();
+        }
+    }
+#endif
+    
+    // Do we want to try provisioning again?
+    bool reprovision = false;
+    if( state.reportFailureCount > MAX_REPORT_RETRIES)
+    {
+        state.reportFailureCount = 0;
+        reprovision = true;
+    }
+    
+    if( state.debugLogging )
+    {
+        Particle.publish("sensDebugLog", String::format("Sensor reads and payloads took %lu ticks", (unsigned long)workTicks), PRIVATE);
+    }
+    
+    return reprovision;
+}
+
+template <typename Node>
+bool nodeMeasure(Node &envNode, EmonLink &emonLink, NodeState &state)
+{
+    NodeCycleObserver observer;
+    return nodeMeasure(envNode, emonLink, state, observer);
+}
+
+#endif
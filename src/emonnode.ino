@@ -31,18 +31,20 @@
 
 #include "EmonLink.h"
 #include "EnvNode.h"
+#include "NodeCycle.h"
 #include "dysonController.h"
 
+#ifdef ENVNODE_SENSORS
+FixedEnvNode envNode;
+#else
 EnvNode envNode;
+#endif
 EmonLink emonLink;
 DysonController dysonController;
 
 
-// Simple variable output from our devices
-double temperature;
-double enclosureTemperature;
-double pressure;
-double humidity;
+// Simple variable output from our devices, and the rest of the measurement cycle's state
+NodeState nodeState;
 
 Timer sensorInitTimer(20000, searchForSensors);
 Timer provisioningTimer(10000, provisionEmonCMSNode);
@@ -52,7 +54,6 @@ Timer measurementTimer(30000, refreshSensorReadings);
 String myCloudName;
 char dev_name[32] = "";
 bool publishName = false;
-bool debugLogging = false;
 bool dysonControl = false;
 
 // Some control flags
@@ -61,8 +62,6 @@ bool takeSensorMeasurement = false;
 bool attemptSensorInit = false;
 bool resetFlag = false;
 
-int  reportFailureCount = 0;
-
 #define DELAY_BEFORE_REBOOT 2000
 unsigned int rebootDelayMillis = DELAY_BEFORE_REBOOT;
 unsigned long rebootSync = millis();
@@ -79,16 +78,11 @@ void setup() {
     Particle.function("dyson", setDysonControl);
     
     // Publish some variables to play with in the console
-    Particle.variable("temperature", temperature);  
-    Particle.variable("enctemp", enclosureTemperature); 
-    Particle.variable("pressure", pressure); 
-    Particle.variable("humidity", humidity); 
-    
-    // Initialise our shared variabled
-    temperature = 255.0;
-    enclosureTemperature = 255.0;
-    humidity = 255.0;
-    pressure = 0.0;
+    // (NodeState starts them off at their "no reading" values)
+    Particle.variable("temperature", nodeState.temperature);  
+    Particle.variable("enctemp", nodeState.enclosureTemperature); 
+    Particle.variable("pressure", nodeState.pressure); 
+    Particle.variable("humidity", nodeState.humidity); 
 
     // Initialise the sensor handler first time
     // If it doesn't work, we'll retry on a timer
@@ -99,8 +93,9 @@ void setup() {
     provisioningTimer.start();
     measurementTimer.start();
     
-    // If both sensors not found, start the rettry timer
-    if( !envNode.bmeFound() || !envNode.ds18Found() ) {
+    // If the sensors were not all found, start the rettry timer
+    // (In a fixed sensor set build, that is any fitted sensor which failed to start)
+    if( !envNode.allSensorsFound() ) {
         sensorInitTimer.start();
     }
     
@@ -120,34 +115,15 @@ void loop() {
     }
     
     // Now check for timer triggered actions
+    // The cycle itself is in NodeCycle.h, shared with the load generator: here we just drive the timers
     
     if( attemptSensorInit) 
     {
         // The timer will turn this back on, if running
         attemptSensorInit = false;
         
-        Particle.publish("INFO", "Retrying searching for sensors");
-        
-        envNode.initSensors();
-        
-        String bmeMsg = "I will ";
-        if( !envNode.bmeFound())
-        {
-            bmeMsg.concat("NOT currently be able to ");
-        }
-        bmeMsg.concat("report BME280 sensor data");
-        Particle.publish("INFO",bmeMsg);
-            
-        String ds18Msg = "I will ";
-        if( !envNode.ds18Found())
-        {
-            ds18Msg.concat("NOT currently be able to ");    
-        }
-        ds18Msg.concat("report DS18B20 sensor data");
-        Particle.publish("INFO",ds18Msg);
-            
-        // If we found both sensors, we're done. Kill time timer.
-        if( envNode.bmeFound() && envNode.ds18Found()) {
+        // If we found all the sensors, we're done. Kill time timer.
+        if( nodeSearchSensors(envNode)) {
             sensorInitTimer.stop();       // No need to search again
         }        
     }
@@ -158,35 +134,10 @@ void loop() {
         // The timer will turn this back on, if running
         attemptCMSProvisioning = false;
 
-        if( emonLink.attemptProvisioning())
+        if( nodeProvision(envNode, emonLink))
         {
-            Particle.publish("INFO","Provisioned and ready to talk to emonpi");
-            // What will we publish?
-            
-            String bmeMsg = "I will ";
-            if( !envNode.bmeFound())
-            {
-                bmeMsg.concat("NOT currently be able to ");
-            }
-            bmeMsg.concat("report BME280 sensor data");
-            Particle.publish("INFO",bmeMsg);
-            
-            String ds18Msg = "I will ";
-            if( !envNode.ds18Found())
-            {
-                ds18Msg.concat("NOT currently be able to ");    
-            }
-            ds18Msg.concat("report DS18B20 sensor data");
-            Particle.publish("INFO",ds18Msg);
-            
             provisioningTimer.stop();       // Kill the timer. To reprovision a node, force a reboot via the Particle console.
         }
-        else
-        {
-            // Set a timer to try provisioning again, in 30 seconds
-            Particle.publish("DEBUG","Not provisioned to emonpi. Will retry ...");
-        }
-
     }
     
     // Measurement time
@@ -194,63 +145,9 @@ void loop() {
     {
         takeSensorMeasurement = false;
         
-        // We do two separate data posts to emonCMS to make this code very simple
-        if( envNode.bmeFound() )
-        {
-            enclosureTemperature = envNode.getEnclosureTemp();
-            pressure = envNode.getPressure();
-            humidity = envNode.getHumidity();
-        
-            // Publish on the event stream as an attidition way of getting them
-            Particle.publish("ENCTEMP", String::format("%.2f", enclosureTemperature));
-            Particle.publish("PRESSURE", String::format("%.2f", pressure));
-            Particle.publish("HUMIDITY", String::format("%.2f", humidity));
-            
-            // Post to emoncms
-            if( emonLink.isProvisioned())
-            {
-                if( !emonLink.postInternalSensorData(enclosureTemperature, pressure, humidity))
-                {
-                    // Somethihg wrong: emonCMS node might be offline
-                    // We start a counter - if it fails enough times, we'll trigger a reprovisioning
-                    reportFailureCount++;
-                }
-                else
-                {
-                    reportFailureCount = 0;
-                }
-            }
-            
-        }
-
-    
-        if( envNode.ds18Found() )
-        {
-            temperature = envNode.getExternalTemp();
-            
-            // Publish on the event stream
-            Particle.publish("EXTTEMP", String::format("%.2f", temperature));   
-            
-            // Post to emoncms
-            if( emonLink.isProvisioned())
-            {
-                if( !emonLink.postExternalSensorData(temperature))
-                {
-                    // Somethihg wrong: emonCMS node might be offline
-                    // We start a counter - if it fails enough times, we'll trigger a reprovisioning
-                    reportFailureCount++;
-                }
-                else
-                {
-                    reportFailureCount = 0;
-                }              
-            }
-        }
-        
-        // Do we want to try provisioning again?
-        if( reportFailureCount > MAX_REPORT_RETRIES)
+        // Failing to post for long enough means we try provisioning again
+        if( nodeMeasure(envNode, emonLink, nodeState))
         {
-            reportFailureCount = 0;
             provisioningTimer.start(); 
         }
     }
@@ -276,7 +173,7 @@ void searchForSensors(void)
 {
     // If either sensor is not detected, try again
     // All our nodes should have both sensors, but sometimes finding the DS18 is not reliable
-    if( !envNode.bmeFound() || !envNode.ds18Found() ) {
+    if( !envNode.allSensorsFound() ) {
         attemptSensorInit = true;    
     }
 }
@@ -304,8 +201,8 @@ int cloudResetFunction(String command) {
 // For now just a dumb function that toggles debug state
 // Debug state writes to google sheets via our configured webhook
 int toggleDebugFunction(String command) {
-    debugLogging = !debugLogging;  
-    emonLink.setDebugLogging(debugLogging);
+    nodeState.debugLogging = !nodeState.debugLogging;  
+    emonLink.setDebugLogging(nodeState.debugLogging);
     
     return 0;
 }
@@ -0,0 +1,534 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * LAN collector: receives node datagrams over UDP and forwards them to emonCMS in bulk
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Collector.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define MAX_HELD_PACKETS 8
+
+static long nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+CollectorConfig::CollectorConfig(void)
+    : listenAddress("0.0.0.0"), udpPort(ENVPACKET_COLLECTOR_PORT),
+      emonHost("emonpi.oakglen.park"), emonPort(80),
+      provisioningHost("emonpi.oakglen.park"), provisioningPort(5000),
+      batchSize(200), flushIntervalMs(10000), maxQueued(20000), lookupRetrySecs(60), unreachableRetrySecs(10),
+      verbose(false)
+{
+}
+
+Collector::Collector(const CollectorConfig &config)
+    : _config(config), _fd(-1), _port(0), _running(false),
+      _lookups(config.provisioningHost, config.provisioningPort),
+      _posts(config.emonHost, config.emonPort),
+      _lastFlushMs(nowMs()), _flushing(false)
+{
+}
+
+Collector::~Collector(void)
+{
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool Collector::begin(void)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_config.udpPort);
+    
+    if (inet_pton(AF_INET, _config.listenAddress.c_str(), &addr.sin_addr) != 1) {
+        return false;
+    }
+    
+    if (!_lookups.start() || !_posts.start()) {
+        return false;
+    }
+    
+    _fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (_fd < 0) {
+        return false;
+    }
+    
+    // A whole fleet reports at about the same time: give the kernel room to queue them while we post
+    int bufferSize = 4 * 1024 * 1024;
+    setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    
+    socklen_t len = sizeof(addr);
+    if (bind(_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || getsockname(_fd, (struct sockaddr *)&addr, &len) != 0) {
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+    
+    _port = ntohs(addr.sin_port);
+    _running = true;
+    return true;
+}
+
+void Collector::run(void)
+{
+    while (_running) {
+        poll(200);
+    }
+    
+    receive();
+    completeLookups();
+    flush();
+}
+
+void Collector::stop(void)
+{
+    _running = false;
+}
+
+void Collector::poll(int timeoutMs)
+{
+    struct pollfd pfd[3];
+    pfd[0].fd = _fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = _lookups.fd();
+    pfd[1].events = POLLIN;
+    pfd[2].fd = _posts.fd();
+    pfd[2].events = POLLIN;
+    
+    // Sleep until the next flush. While a post is out, its answer wakes us instead.
+    long untilFlush = _lastFlushMs + _config.flushIntervalMs - nowMs();
+    if (!_flushing && untilFlush < timeoutMs) {
+        timeoutMs = (untilFlush > 0) ? untilFlush : 0;
+    }
+    
+    if (::poll(pfd, 3, timeoutMs) > 0)
+    {
+        if (pfd[2].revents & POLLIN) {
+            completePosts();
+        }
+        if (pfd[1].revents & POLLIN) {
+            completeLookups();
+        }
+        if (pfd[0].revents & POLLIN) {
+            receive();
+        }
+    }
+    
+    if (flushDue()) {
+        startFlush();
+    }
+}
+
+// Drain everything the socket has for us
+void Collector::receive(void)
+{
+    uint8_t buffer[ENVPACKET_MAX_LEN + 1];
+    
+    while (true)
+    {
+        struct sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+        
+        ssize_t len = recvfrom(_fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &fromLen);
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len < 0) {
+            break;
+        }
+        
+        handleDatagram(buffer, len, from);
+        
+        if (flushDue()) {
+            startFlush();
+        }
+    }
+}
+
+void Collector::handleDatagram(const uint8_t *buffer, size_t len, const struct sockaddr_in &from)
+{
+    EnvPacket packet;
+    char deviceId[2 * ENVPACKET_DEVICE_ID_LEN + 1];
+    
+    _stats.datagrams++;
+    
+    if (!envPacketDecode(buffer, len, packet)) {
+        _stats.malformed++;
+        return;
+    }
+    
+    envPacketFormatDeviceId(packet.deviceId, deviceId);
+    
+    Node &node = _nodes[deviceId];
+    time_t now = time(NULL);
+    
+    if (node.known) {
+        acceptPacket(node, packet, now, from);
+        return;
+    }
+    
+    // The first we've heard from this device, or time to ask about it again: the provisioning
+    // service tells us its emon name and API key. Hold its readings until it answers.
+    if (!node.lookingUp && now >= node.retryAt)
+    {
+        node.lookingUp = true;
+        _lookups.request(deviceId);
+    }
+    
+    if (!node.lookingUp)
+    {
+        // Recently looked up, and no good: don't hammer the provisioning service
+        if (node.lastLookup == LOOKUP_UNREACHABLE) {
+            _stats.unresolved++;
+        } else {
+            _stats.unknownDevices++;
+        }
+        return;
+    }
+    
+    // A node reports every 30 seconds, so a few is plenty to cover a slow lookup
+    if (node.held.size() >= MAX_HELD_PACKETS) {
+        node.held.pop_front();
+        _stats.dropped++;
+    }
+    
+    HeldPacket held;
+    held.time = now;
+    held.from = from;
+    held.packet = packet;
+    node.held.push_back(held);
+}
+
+// Deduplicate, and queue the readings for the next bulk post
+// Repeats are acknowledged too: the node sent again because it missed our first ack
+void Collector::acceptPacket(Node &node, const EnvPacket &packet, time_t received, const struct sockaddr_in &from)
+{
+    bool accepted = node.window.accept(packet.bootId, packet.sequence);
+    
+    sendAck(node, from);
+    
+    if (!accepted) {
+        _stats.duplicates++;
+        return;
+    }
+    
+    // Post under the node's own name, as it would directly. Only a node that doesn't know its cloud name yet
+    // (just booted) leaves it out: then all we have is the provisioning service's name for it.
+    Entry entry;
+    entry.time = received;
+    entry.name = (packet.name[0] != '\0') ? packet.name : node.name;
+    entry.json = "{";
+    
+    for (uint8_t i = 0; i < packet.count; i++)
+    {
+        const char *key = envPacketKeyName(packet.readings[i].key);
+        char value[24];
+        
+        // A newer node may send keys we don't know: leave them out rather than guess
+        if (key == NULL) {
+            continue;
+        }
+        
+        snprintf(value, sizeof(value), "%.2f", envPacketFromFixed(packet.readings[i].value));
+        
+        if (entry.json.size() > 1) {
+            entry.json += ",";
+        }
+        entry.json += std::string("\"") + key + "\":" + value;
+    }
+    entry.json += "}";
+    
+    if (entry.json.size() == 2) {
+        return;
+    }
+    
+    if (_config.verbose) {
+        char deviceId[2 * ENVPACKET_DEVICE_ID_LEN + 1];
+        envPacketFormatDeviceId(packet.deviceId, deviceId);
+        fprintf(stderr, "%s (%s) boot %u seq %u: %s\n", entry.name.c_str(), deviceId, packet.bootId, packet.sequence, entry.json.c_str());
+    }
+    
+    _queues[node.apiKey].push_back(entry);
+    _stats.queued++;
+    trimQueues();
+}
+
+// Once the readings are queued they're ours to deliver: tell the node, so it doesn't fall back to posting them itself
+void Collector::sendAck(const Node &node, const struct sockaddr_in &to)
+{
+    uint8_t ack[ENVPACKET_ACK_LEN];
+    size_t len = envPacketEncodeAck(node.window.bootId(), node.window.highest(), ack, sizeof(ack));
+    
+    if (sendto(_fd, ack, len, 0, (const struct sockaddr *)&to, sizeof(to)) == (ssize_t)len) {
+        _stats.acks++;
+    }
+}
+
+// Answers from the provisioning service: release or drop what each device sent while we waited
+void Collector::completeLookups(void)
+{
+    LookupReply reply;
+    
+    while (_lookups.takeReply(reply))
+    {
+        Node &node = _nodes[reply.deviceId];
+        node.lookingUp = false;
+        node.lastLookup = reply.result;
+        
+        switch (reply.result)
+        {
+            case LOOKUP_FOUND:
+                if (_config.verbose) {
+                    fprintf(stderr, "Device %s is %s\n", reply.deviceId.c_str(), reply.name.c_str());
+                }
+                node.known = true;
+                node.name = reply.name;
+                node.apiKey = reply.apiKey;
+                
+                while (!node.held.empty()) {
+                    acceptPacket(node, node.held.front().packet, node.held.front().time, node.held.front().from);
+                    node.held.pop_front();
+                }
+                break;
+                
+            case LOOKUP_UNKNOWN:
+                fprintf(stderr, "Device %s not recognised by the provisioning service. Will ask again in %d seconds\n", reply.deviceId.c_str(), _config.lookupRetrySecs);
+                node.retryAt = time(NULL) + _config.lookupRetrySecs;
+                _stats.unknownDevices += node.held.size();
+                node.held.clear();
+                break;
+                
+            case LOOKUP_UNREACHABLE:
+                fprintf(stderr, "Can't reach the provisioning service to look up device %s. Will try again in %d seconds\n", reply.deviceId.c_str(), _config.unreachableRetrySecs);
+                node.retryAt = time(NULL) + _config.unreachableRetrySecs;
+                _stats.unresolved += node.held.size();
+                node.held.clear();
+                break;
+        }
+    }
+    
+    if (flushDue()) {
+        startFlush();
+    }
+}
+
+// A full batch ready to go, or the flush interval is up: unless we're posting already
+bool Collector::flushDue(void) const
+{
+    long now = nowMs();
+    
+    if (_flushing) {
+        return false;
+    }
+    return readyCount(now) >= _config.batchSize || now - _lastFlushMs >= _config.flushIntervalMs;
+}
+
+void Collector::flush(void)
+{
+    // Last chance: try every queue, even those that failed a moment ago. If a post is out already,
+    // the round it belongs to carries on through them.
+    _retryAtMs.clear();
+    if (!_flushing) {
+        startFlush();
+    }
+    
+    while (_flushing)
+    {
+        struct pollfd pfd;
+        pfd.fd = _posts.fd();
+        pfd.events = POLLIN;
+        
+        if (::poll(&pfd, 1, -1) > 0) {
+            completePosts();
+        }
+    }
+}
+
+void Collector::startFlush(void)
+{
+    _lastFlushMs = nowMs();
+    _flushing = true;
+    postNext();
+}
+
+// Hand the post thread up to a batch from the front of the first queue with anything ready to go
+void Collector::postNext(void)
+{
+    long nowMillis = nowMs();
+    
+    std::map<std::string, std::deque<Entry> >::iterator it = _queues.begin();
+    while (it != _queues.end() && (it->second.empty() || !keyReady(it->first, nowMillis))) {
+        ++it;
+    }
+    
+    if (it == _queues.end()) {
+        _flushing = false;
+        return;
+    }
+    
+    std::deque<Entry> &queue = it->second;
+    size_t count = std::min(queue.size(), _config.batchSize);
+    
+    _postingKey = it->first;
+    _posting.assign(queue.begin(), queue.begin() + count);
+    queue.erase(queue.begin(), queue.begin() + count);
+    
+    time_t now = time(NULL);
+    
+    // [[offset,"node",{"key":value,...}],...] with offsets relative to time=now
+    std::string data = "[";
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i > 0) {
+            data += ",";
+        }
+        data += "[" + std::to_string((long)(_posting[i].time - now)) + ",\"" + jsonEscape(_posting[i].name) + "\"," + _posting[i].json + "]";
+    }
+    data += "]";
+    
+    std::string path = "/input/bulk?time=" + std::to_string((long)now) + "&apikey=" + urlEncode(_postingKey);
+    _posts.request(path, "data=" + urlEncode(data));
+}
+
+// Answers from emonCMS: the batch is done with, or goes back on the front of its queue for the next round.
+// Either way, carry on with the other queues.
+void Collector::completePosts(void)
+{
+    HttpResponse response;
+    
+    while (_posts.takeReply(response))
+    {
+        _stats.bulkPosts++;
+        
+        // emonCMS answers 200 even when it rejects the data, so check what it said too
+        if (response.status == 200 && response.body.compare(0, 2, "ok") == 0)
+        {
+            _stats.posted += _posting.size();
+        }
+        else if (response.status == 200 || (response.status >= 400 && response.status < 500))
+        {
+            // A bad API key, or data it won't take: posting it again won't change its mind
+            fprintf(stderr, "emonCMS rejected a bulk post of %zu, dropping it: %d %s\n", _posting.size(), response.status, response.body.c_str());
+            _stats.rejected += _posting.size();
+        }
+        else
+        {
+            // emonCMS unavailable: keep what we have, and give this queue a rest until the next round
+            fprintf(stderr, "Bulk post of %zu failed: %d %s\n", _posting.size(), response.status, response.body.c_str());
+            _stats.postFailures++;
+            
+            std::deque<Entry> &queue = _queues[_postingKey];
+            queue.insert(queue.begin(), _posting.begin(), _posting.end());
+            _retryAtMs[_postingKey] = _lastFlushMs + _config.flushIntervalMs;
+        }
+        
+        _posting.clear();
+        trimQueues();
+        postNext();
+    }
+}
+
+bool Collector::keyReady(const std::string &apiKey, long now) const
+{
+    std::map<std::string, long>::const_iterator it = _retryAtMs.find(apiKey);
+    return it == _retryAtMs.end() || now >= it->second;
+}
+
+size_t Collector::queuedCount(void) const
+{
+    size_t count = 0;
+    
+    for (std::map<std::string, std::deque<Entry> >::const_iterator it = _queues.begin(); it != _queues.end(); ++it) {
+        count += it->second.size();
+    }
+    return count;
+}
+
+// Queued readings that could be posted now
+size_t Collector::readyCount(long now) const
+{
+    size_t count = 0;
+    
+    for (std::map<std::string, std::deque<Entry> >::const_iterator it = _queues.begin(); it != _queues.end(); ++it)
+    {
+        if (keyReady(it->first, now)) {
+            count += it->second.size();
+        }
+    }
+    return count;
+}
+
+// Drop the oldest readings once we're holding too many
+void Collector::trimQueues(void)
+{
+    while (queuedCount() > _config.maxQueued)
+    {
+        std::deque<Entry> *oldest = NULL;
+        
+        for (std::map<std::string, std::deque<Entry> >::iterator it = _queues.begin(); it != _queues.end(); ++it)
+        {
+            if (!it->second.empty() && (oldest == NULL || it->second.front().time < oldest->front().time)) {
+                oldest = &it->second;
+            }
+        }
+        
+        oldest->pop_front();
+        _stats.dropped++;
+    }
+}
+
+int Collector::udpPort(void) const
+{
+    return _port;
+}
+
+long Collector::emonConnections(void) const
+{
+    return _posts.connects();
+}
+
+const CollectorStats &Collector::stats(void) const
+{
+    return _stats;
+}
@@ -0,0 +1,176 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * LAN collector: receives node datagrams over UDP and forwards them to emonCMS in bulk
+ * Instead of one HTTP connection per node per cycle, emonCMS sees a few large /input/bulk posts over one persistent connection
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef collector_h
+#define collector_h
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <string>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "EnvPacket.h"
+#include "LookupQueue.h"
+#include "PostQueue.h"
+#include "SequenceWindow.h"
+
+struct CollectorConfig
+{
+    CollectorConfig(void);
+    
+    std::string listenAddress;
+    int udpPort;
+    
+    std::string emonHost;
+    int emonPort;
+    
+    std::string provisioningHost;
+    int provisioningPort;
+    
+    size_t batchSize;           // Readings sets per bulk post, and the queue length that triggers a post
+    int flushIntervalMs;        // Post at least this often, however few are queued
+    size_t maxQueued;           // If emonCMS is away for long, drop the oldest beyond this
+    int lookupRetrySecs;        // How long to wait before asking about an unknown device again
+    int unreachableRetrySecs;   // ... or about any device, when the provisioning service didn't answer
+    
+    bool verbose;
+};
+
+struct CollectorStats
+{
+    CollectorStats(void) : datagrams(0), malformed(0), duplicates(0), unknownDevices(0), unresolved(0), acks(0), queued(0), posted(0), bulkPosts(0), postFailures(0), rejected(0), dropped(0) {}
+    
+    long datagrams;
+    long malformed;
+    long duplicates;
+    long unknownDevices;        // Datagrams from devices the provisioning service doesn't know
+    long unresolved;            // Datagrams from devices we couldn't look up, because the service didn't answer
+    long acks;
+    long queued;
+    long posted;                // Reading sets accepted by emonCMS
+    long bulkPosts;
+    long postFailures;          // Bulk posts to try again: no answer, or a 5xx
+    long rejected;              // Reading sets emonCMS refused outright, and we gave up on
+    long dropped;               // Reading sets given up on because the queue was full
+};
+
+class Collector
+{
+    public:
+        Collector(const CollectorConfig &config);
+        ~Collector(void);
+        
+        bool begin(void);           // Open the UDP socket
+        
+        // Run until stop(), then post anything still queued
+        void run(void);
+        void stop(void);            // Safe to call from a signal handler
+        
+        // Handle whatever arrives in the next timeoutMs, and start posting if a batch is due
+        void poll(int timeoutMs);
+        
+        // Post everything queued now, and wait until emonCMS has it or has failed us
+        void flush(void);
+        
+        int udpPort(void) const;
+        long emonConnections(void) const;
+        const CollectorStats &stats(void) const;
+        
+    private:
+    
+        // Datagrams from a device held while we look it up
+        struct HeldPacket
+        {
+            time_t time;
+            struct sockaddr_in from;
+            EnvPacket packet;
+        };
+        
+        struct Node
+        {
+            Node(void) : known(false), lookingUp(false), lastLookup(LOOKUP_UNKNOWN), retryAt(0) {}
+            
+            bool known;
+            bool lookingUp;
+            LookupResult lastLookup;
+            time_t retryAt;
+            std::string name;
+            std::string apiKey;
+            SequenceWindow window;
+            std::deque<HeldPacket> held;
+        };
+        
+        struct Entry
+        {
+            time_t time;
+            std::string name;
+            std::string json;       // {"encTemp":21.50,...}
+        };
+        
+        void receive(void);
+        void handleDatagram(const uint8_t *buffer, size_t len, const struct sockaddr_in &from);
+        void acceptPacket(Node &node, const EnvPacket &packet, time_t received, const struct sockaddr_in &from);
+        void sendAck(const Node &node, const struct sockaddr_in &to);
+        void completeLookups(void);
+        bool flushDue(void) const;
+        void startFlush(void);
+        void postNext(void);
+        void completePosts(void);
+        bool keyReady(const std::string &apiKey, long now) const;
+        size_t queuedCount(void) const;
+        size_t readyCount(long now) const;
+        void trimQueues(void);
+        
+        CollectorConfig _config;
+        int _fd;
+        int _port;
+        std::atomic<bool> _running;
+        
+        LookupQueue _lookups;
+        PostQueue _posts;
+        
+        std::map<std::string, Node> _nodes;                     // By device ID
+        std::map<std::string, std::deque<Entry> > _queues;      // By API key: a bulk post carries one key
+        long _lastFlushMs;
+        std::map<std::string, long> _retryAtMs;                 // By API key: a queue whose last post failed waits a round
+        bool _flushing;                                         // Posting batches until the queues are empty
+        
+        // The batch emonCMS has now, out of its queue until it answers. One at a time, so they arrive in order.
+        std::string _postingKey;
+        std::deque<Entry> _posting;
+        
+        CollectorStats _stats;
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Provisioning lookups on a thread of their own, so a slow or absent service doesn't hold up the UDP receive loop
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LookupQueue.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+LookupQueue::LookupQueue(const std::string &host, int port)
+    : _client(host, port), _stopping(false)
+{
+    _pipe[0] = _pipe[1] = -1;
+}
+
+LookupQueue::~LookupQueue(void)
+{
+    if (_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wake.notify_one();
+        _thread.join();
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        if (_pipe[i] >= 0) {
+            close(_pipe[i]);
+        }
+    }
+}
+
+bool LookupQueue::start(void)
+{
+    if (pipe2(_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        return false;
+    }
+    
+    _thread = std::thread(&LookupQueue::work, this);
+    return true;
+}
+
+void LookupQueue::request(const std::string &deviceId)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _requests.push_back(deviceId);
+    }
+    _wake.notify_one();
+}
+
+bool LookupQueue::takeReply(LookupReply &reply)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    if (_replies.empty())
+    {
+        // Everything signalled has been taken: quieten the pipe until the next reply
+        char drain[64];
+        while (read(_pipe[0], drain, sizeof(drain)) > 0) {
+        }
+        return false;
+    }
+    
+    reply = _replies.front();
+    _replies.pop_front();
+    return true;
+}
+
+int LookupQueue::fd(void) const
+{
+    return _pipe[0];
+}
+
+void LookupQueue::work(void)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    
+    while (true)
+    {
+        _wake.wait(lock, [this] { return _stopping || !_requests.empty(); });
+        if (_stopping) {
+            return;
+        }
+        
+        LookupReply reply;
+        reply.deviceId = _requests.front();
+        _requests.pop_front();
+        
+        // The service can take its time (or time out): don't hold the lock while it does
+        lock.unlock();
+        reply.result = _client.lookup(reply.deviceId, reply.name, reply.apiKey);
+        lock.lock();
+        
+        _replies.push_back(reply);
+        
+        char signal = 1;
+        if (write(_pipe[1], &signal, 1) < 0) {
+            // Pipe full: there's a wakeup waiting already
+        }
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Provisioning lookups on a thread of their own, so a slow or absent service doesn't hold up the UDP receive loop
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef lookupqueue_h
+#define lookupqueue_h
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "ProvisioningClient.h"
+
+struct LookupReply
+{
+    std::string deviceId;
+    LookupResult result;
+    std::string name;
+    std::string apiKey;
+};
+
+class LookupQueue
+{
+    public:
+        LookupQueue(const std::string &host, int port);
+        ~LookupQueue(void);
+        
+        bool start(void);
+        
+        // Ask about a device: the reply turns up in takeReply() later
+        void request(const std::string &deviceId);
+        
+        // Next finished lookup, if any
+        bool takeReply(LookupReply &reply);
+        
+        // Readable when there may be replies: poll() it alongside the sockets
+        int fd(void) const;
+        
+    private:
+    
+        void work(void);
+        
+        ProvisioningClient _client;
+        
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::deque<std::string> _requests;
+        std::deque<LookupReply> _replies;
+        bool _stopping;
+        
+        int _pipe[2];
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Bulk posts to emonCMS on a thread of their own, so a slow or hung emonCMS doesn't hold up the UDP receive loop and its acks
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef postqueue_h
+#define postqueue_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "HttpConnection.h"
+
+struct PostRequest
+{
+    std::string path;
+    std::string body;
+};
+
+class PostQueue
+{
+    public:
+        PostQueue(const std::string &host, int port);
+        ~PostQueue(void);
+        
+        bool start(void);
+        
+        // Queue a post: they go one at a time, in order, over one persistent connection.
+        // Its response turns up in takeReply() later, in the same order.
+        void request(const std::string &path, const std::string &body);
+        
+        // Next finished post, if any
+        bool takeReply(HttpResponse &response);
+        
+        // Readable when there may be replies: poll() it alongside the sockets
+        int fd(void) const;
+        
+        // Number of TCP connections opened to emonCMS so far
+        long connects(void) const;
+        
+    private:
+    
+        void work(void);
+        
+        HttpConnection _emon;
+        
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::deque<PostRequest> _requests;
+        std::deque<HttpResponse> _replies;
+        bool _stopping;
+        std::atomic<long> _connects;
+        
+        int _pipe[2];
+};
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Looks nodes up in the provisioning service on the emonpi, the same call the nodes make for themselves
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ProvisioningClient.h"
+
+ProvisioningClient::ProvisioningClient(const std::string &host, int port)
+    : _connection(host, port)
+{
+}
+
+LookupResult ProvisioningClient::lookup(const std::string &deviceId, std::string &name, std::string &apiKey)
+{
+    HttpResponse response = _connection.get("/api/v1/nodes/?id=" + urlEncode(deviceId));
+    std::string returnedId;
+    
+    if (response.status < 0 || response.status >= 500) {
+        return LOOKUP_UNREACHABLE;
+    }
+    
+    // As on the node: if we were recognised, our ID comes back to us
+    if (response.status != 200 || !jsonValue(response.body, "id", returnedId) || returnedId != deviceId) {
+        return LOOKUP_UNKNOWN;
+    }
+    
+    if (!jsonValue(response.body, "apikey", apiKey) || !jsonValue(response.body, "name", name)) {
+        return LOOKUP_UNREACHABLE;
+    }
+    return LOOKUP_FOUND;
+}
@@ -0,0 +1,59 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Looks nodes up in the provisioning service on the emonpi, the same call the nodes make for themselves
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef provisioningclient_h
+#define provisioningclient_h
+
+#include <string>
+
+#include "HttpConnection.h"
+
+enum LookupResult
+{
+    LOOKUP_FOUND,
+    LOOKUP_UNKNOWN,             // The service answered, and doesn't know this device
+    LOOKUP_UNREACHABLE          // No useful answer: the service is down, or broken
+};
+
+class ProvisioningClient
+{
+    public:
+        ProvisioningClient(const std::string &host, int port);
+        
+        // name and apiKey are only set for LOOKUP_FOUND
+        LookupResult lookup(const std::string &deviceId, std::string &name, std::string &apiKey);
+        
+    private:
+    
+        HttpConnection _connection;
+};
+
+#endif
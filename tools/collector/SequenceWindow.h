@@ -0,0 +1,92 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Duplicate detection for node datagrams
+ * Nodes send each datagram more than once, and UDP can deliver late or twice, so the collector keeps a window of recently seen sequence numbers per node
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef sequencewindow_h
+#define sequencewindow_h
+
+#include <stdint.h>
+
+class SequenceWindow
+{
+    public:
+        SequenceWindow(void) : _started(false), _bootId(0), _highest(0), _seen(0) {}
+        
+        // True the first time a (boot, sequence) pair is seen, false for repeats and for anything too old to tell
+        // A different boot ID means the node restarted: its sequence numbers start again
+        bool accept(uint32_t bootId, uint32_t sequence)
+        {
+            if (!_started || bootId != _bootId)
+            {
+                _started = true;
+                _bootId = bootId;
+                _highest = sequence;
+                _seen = 1;
+                return true;
+            }
+            
+            // Serial number arithmetic, so the window carries on across the wrap from 0xffffffff to 0
+            int32_t ahead = (int32_t)(sequence - _highest);
+            
+            if (ahead > 0)
+            {
+                _seen = (ahead >= 64) ? 1 : ((_seen << ahead) | 1);
+                _highest = sequence;
+                return true;
+            }
+            
+            uint32_t age = _highest - sequence;
+            if (age >= 64) {
+                return false;
+            }
+            
+            uint64_t bit = (uint64_t)1 << age;
+            if (_seen & bit) {
+                return false;
+            }
+            
+            _seen |= bit;
+            return true;
+        }
+        
+        // What to acknowledge: the current boot, and the newest sequence number accepted from it
+        uint32_t bootId(void) const { return _bootId; }
+        uint32_t highest(void) const { return _highest; }
+        
+    private:
+    
+        bool _started;
+        uint32_t _bootId;
+        uint32_t _highest;
+        uint64_t _seen;         // Bit n set: _highest - n has been seen
+};
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * emon-collector: LAN collector service for nodes in collector mode
+ *
+ * Usage: emon-collector [--listen ADDR] [--port N] [--emon HOST[:PORT]] [--provisioning HOST[:PORT]]
+ *                       [--batch N] [--flush-ms N] [--max-queued N] [--verbose]
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Collector.h"
+
+static Collector *collector = NULL;
+
+static void stopHandler(int)
+{
+    if (collector != NULL) {
+        collector->stop();
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: emon-collector [--listen ADDR] [--port N] [--emon HOST[:PORT]] [--provisioning HOST[:PORT]]\n"
+                    "                      [--batch N] [--flush-ms N] [--max-queued N] [--verbose]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    CollectorConfig config;
+    
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        
+        if (arg == "--verbose") {
+            config.verbose = true;
+            continue;
+        }
+        
+        if (i + 1 >= argc) {
+            usage();
+        }
+        std::string value = argv[++i];
+        
+        if (arg == "--listen") {
+            config.listenAddress = value;
+        } else if (arg == "--port") {
+            config.udpPort = atoi(value.c_str());
+        } else if (arg == "--emon") {
+            splitHostPort(value, config.emonHost, config.emonPort);
+        } else if (arg == "--provisioning") {
+            splitHostPort(value, config.provisioningHost, config.provisioningPort);
+        } else if (arg == "--batch") {
+            config.batchSize = strtoul(value.c_str(), NULL, 10);
+        } else if (arg == "--flush-ms") {
+            config.flushIntervalMs = atoi(value.c_str());
+        } else if (arg == "--max-queued") {
+            config.maxQueued = strtoul(value.c_str(), NULL, 10);
+        } else {
+            usage();
+        }
+    }
+    
+    if (config.batchSize == 0) {
+        usage();
+    }
+    
+    Collector service(config);
+    
+    if (!service.begin())
+    {
+        fprintf(stderr, "Can't listen on %s:%d: %s\n", config.listenAddress.c_str(), config.udpPort, strerror(errno));
+        return 1;
+    }
+    
+    collector = &service;
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+    
+    fprintf(stderr, "Listening on %s:%d, posting to %s:%d\n", config.listenAddress.c_str(), service.udpPort(), config.emonHost.c_str(), config.emonPort);
+    
+    service.run();
+    
+    const CollectorStats &stats = service.stats();
+    fprintf(stderr, "datagrams %ld, malformed %ld, duplicates %ld, unknown %ld, unresolved %ld, queued %ld, posted %ld, dropped %ld\n",
+            stats.datagrams, stats.malformed, stats.duplicates, stats.unknownDevices, stats.unresolved, stats.queued, stats.posted, stats.dropped);
+    fprintf(stderr, "acks %ld, bulk posts %ld (%ld failed, %ld readings rejected) over %ld emonCMS connections\n",
+            stats.acks, stats.bulkPosts, stats.postFailures, stats.rejected, service.emonConnections());
+    
+    return 0;
+}
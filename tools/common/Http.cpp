@@ -0,0 +1,176 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Minimal HTTP/1.1 pieces shared by the collector, the stand-in emonCMS and the load generator
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Http.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+std::string HttpRequest::param(const std::string &name) const
+{
+    std::map<std::string, std::string>::const_iterator it = params.find(name);
+    return it == params.end() ? std::string() : it->second;
+}
+
+std::string urlEncode(const std::string &value)
+{
+    std::string encoded;
+    char hex[4];
+    
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        unsigned char c = value[i];
+        
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += c;
+        } else {
+            snprintf(hex, sizeof(hex), "%%%02X", c);
+            encoded += hex;
+        }
+    }
+    return encoded;
+}
+
+std::string urlDecode(const std::string &value)
+{
+    std::string decoded;
+    
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        if (value[i] == '+') {
+            decoded += ' ';
+        } else if (value[i] == '%' && i + 2 < value.size() && isxdigit((unsigned char)value[i + 1]) && isxdigit((unsigned char)value[i + 2])) {
+            decoded += (char)strtol(value.substr(i + 1, 2).c_str(), NULL, 16);
+            i += 2;
+        } else {
+            decoded += value[i];
+        }
+    }
+    return decoded;
+}
+
+void parseFormParams(const std::string &query, std::map<std::string, std::string> &params)
+{
+    size_t start = 0;
+    
+    while (start < query.size())
+    {
+        size_t end = query.find('&', start);
+        if (end == std::string::npos) {
+            end = query.size();
+        }
+        
+        std::string pair = query.substr(start, end - start);
+        size_t equals = pair.find('=');
+        
+        if (equals == std::string::npos) {
+            params[urlDecode(pair)] = "";
+        } else {
+            params[urlDecode(pair.substr(0, equals))] = urlDecode(pair.substr(equals + 1));
+        }
+        start = end + 1;
+    }
+}
+
+void splitHostPort(const std::string &hostPort, std::string &host, int &port)
+{
+    size_t colon = hostPort.rfind(':');
+    
+    if (colon == std::string::npos) {
+        host = hostPort;
+    } else {
+        host = hostPort.substr(0, colon);
+        port = atoi(hostPort.c_str() + colon + 1);
+    }
+}
+
+std::string jsonEscape(const std::string &value)
+{
+    std::string escaped;
+    
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        unsigned char c = value[i];
+        
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c < 0x20) {
+            char hex[8];
+            snprintf(hex, sizeof(hex), "\\u%04x", c);
+            escaped += hex;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+bool jsonValue(const std::string &json, const std::string &key, std::string &value)
+{
+    size_t pos = json.find("\"" + key + "\"");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    
+    pos = json.find(':', pos + key.size() + 2);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    
+    pos = json.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    
+    if (json[pos] == '"')
+    {
+        // Undo \" and \\: names and keys have no other escapes worth handling
+        value.clear();
+        for (pos++; pos < json.size() && json[pos] != '"'; pos++)
+        {
+            if (json[pos] == '\\' && pos + 1 < json.size()) {
+                pos++;
+            }
+            value += json[pos];
+        }
+        if (pos == json.size()) {
+            return false;
+        }
+    }
+    else
+    {
+        size_t end = json.find_first_of(",} \t\r\n", pos);
+        value = json.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    }
+    return true;
+}
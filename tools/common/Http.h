@@ -0,0 +1,75 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Minimal HTTP/1.1 pieces shared by the collector, the stand-in emonCMS and the load generator
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef http_h
+#define http_h
+
+#include <map>
+#include <string>
+
+struct HttpRequest
+{
+    std::string method;
+    std::string path;                               // Without the query string
+    std::map<std::string, std::string> params;      // Query string, plus the body if it is form encoded
+    std::map<std::string, std::string> headers;     // Names in lower case
+    std::string body;
+    
+    // Value of a query/form parameter, or "" if it wasn't given
+    std::string param(const std::string &name) const;
+};
+
+struct HttpResponse
+{
+    HttpResponse(void) : status(0), close(false) {}
+    
+    int status;                 // -1 if the request failed before a response came back
+    std::string body;
+    std::string contentType;
+    bool close;                 // Server side: close the connection after this response
+};
+
+std::string urlEncode(const std::string &value);
+std::string urlDecode(const std::string &value);
+
+// Parse "a=1&b=2" into params
+void parseFormParams(const std::string &query, std::map<std::string, std::string> &params);
+
+// "host:port" or just "host", which leaves port alone
+void splitHostPort(const std::string &hostPort, std::string &host, int &port);
+
+// Quote-safe contents for a JSON string: escapes quotes, backslashes and control characters
+std::string jsonEscape(const std::string &value);
+
+// Value of a top level string or number member of a flat JSON object. Enough for the provisioning protocol.
+bool jsonValue(const std::string &json, const std::string &key, std::string &value);
+
+#endif
@@ -0,0 +1,354 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Persistent HTTP/1.1 client connection
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "HttpConnection.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+HttpConnection::HttpConnection(const std::string &host, int port, int timeoutMs)
+    : _host(host), _port(port), _timeoutMs(timeoutMs), _fd(-1), _timedOut(false), _connects(0)
+{
+}
+
+HttpConnection::~HttpConnection(void)
+{
+    close();
+}
+
+HttpResponse HttpConnection::get(const std::string &path)
+{
+    return request("GET", path, "", "");
+}
+
+HttpResponse HttpConnection::post(const std::string &path, const std::string &body, const std::string &contentType)
+{
+    return request("POST", path, body, contentType);
+}
+
+void HttpConnection::close(void)
+{
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _buffer.clear();
+}
+
+long HttpConnection::connects(void) const
+{
+    return _connects;
+}
+
+HttpResponse HttpConnection::request(const std::string &method, const std::string &path, const std::string &body, const std::string &contentType)
+{
+    std::string message = method + " " + path + " HTTP/1.1\r\n";
+    message += "Host: " + _host + "\r\n";
+    message += "Connection: keep-alive\r\n";
+    if (method == "POST") {
+        message += "Content-Type: " + contentType + "\r\n";
+        message += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    message += "\r\n";
+    message += body;
+    
+    // If we reused a connection the server has since closed, the first attempt fails without a response: try once more on a new one
+    // A timeout is not retried, the server may well have acted on the request
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        bool reused = (_fd >= 0);
+        HttpResponse response;
+        bool keepAlive = true;
+        
+        _timedOut = false;
+        
+        if (!reused && !open()) {
+            response.status = -1;
+            return response;
+        }
+        
+        if (sendAll(message) && readResponse(response, keepAlive))
+        {
+            if (!keepAlive) {
+                close();
+            }
+            return response;
+        }
+        
+        close();
+        
+        if (!reused || _timedOut || response.status != 0) {
+            response.status = -1;
+            return response;
+        }
+    }
+    
+    HttpResponse failed;
+    failed.status = -1;
+    return failed;
+}
+
+bool HttpConnection::open(void)
+{
+    struct addrinfo hints;
+    struct addrinfo *addresses = NULL;
+    
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    if (getaddrinfo(_host.c_str(), std::to_string(_port).c_str(), &hints, &addresses) != 0 || addresses == NULL) {
+        return false;
+    }
+    
+    _fd = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+    
+    if (_fd >= 0)
+    {
+        struct timeval timeout;
+        timeout.tv_sec = _timeoutMs / 1000;
+        timeout.tv_usec = (_timeoutMs % 1000) * 1000;
+        setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        
+        int one = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        
+        if (!connectWithTimeout(addresses->ai_addr, addresses->ai_addrlen)) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+    
+    freeaddrinfo(addresses);
+    
+    if (_fd < 0) {
+        return false;
+    }
+    
+    _connects++;
+    _buffer.clear();
+    return true;
+}
+
+// Connect without blocking for longer than our timeout if the host is down
+bool HttpConnection::connectWithTimeout(const struct sockaddr *address, socklen_t length)
+{
+    int flags = fcntl(_fd, F_GETFL, 0);
+    fcntl(_fd, F_SETFL, flags | O_NONBLOCK);
+    
+    if (connect(_fd, address, length) != 0)
+    {
+        if (errno != EINPROGRESS) {
+            return false;
+        }
+        
+        struct pollfd pfd;
+        pfd.fd = _fd;
+        pfd.events = POLLOUT;
+        
+        int error = 0;
+        socklen_t errorLen = sizeof(error);
+        
+        if (poll(&pfd, 1, _timeoutMs) != 1 || getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) != 0 || error != 0) {
+            return false;
+        }
+    }
+    
+    fcntl(_fd, F_SETFL, flags);
+    return true;
+}
+
+bool HttpConnection::sendAll(const std::string &data)
+{
+    size_t sent = 0;
+    
+    while (sent < data.size())
+    {
+        ssize_t n = send(_fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+bool HttpConnection::fill(void)
+{
+    struct pollfd pfd;
+    pfd.fd = _fd;
+    pfd.events = POLLIN;
+    
+    int ready;
+    do {
+        ready = poll(&pfd, 1, _timeoutMs);
+    } while (ready < 0 && errno == EINTR);
+    
+    if (ready <= 0) {
+        _timedOut = true;
+        return false;
+    }
+    
+    char chunk[4096];
+    ssize_t n = recv(_fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+        return false;
+    }
+    
+    _buffer.append(chunk, n);
+    return true;
+}
+
+bool HttpConnection::readLine(std::string &line)
+{
+    size_t end;
+    
+    while ((end = _buffer.find("\r\n")) == std::string::npos)
+    {
+        if (!fill()) {
+            return false;
+        }
+    }
+    
+    line = _buffer.substr(0, end);
+    _buffer.erase(0, end + 2);
+    return true;
+}
+
+bool HttpConnection::readBytes(size_t count, std::string &out)
+{
+    while (_buffer.size() < count)
+    {
+        if (!fill()) {
+            return false;
+        }
+    }
+    
+    out.append(_buffer, 0, count);
+    _buffer.erase(0, count);
+    return true;
+}
+
+bool HttpConnection::readResponse(HttpResponse &response, bool &keepAlive)
+{
+    std::string line;
+    
+    // Status line: HTTP/1.1 200 OK
+    if (!readLine(line) || line.compare(0, 5, "HTTP/") != 0) {
+        return false;
+    }
+    
+    size_t space = line.find(' ');
+    if (space == std::string::npos) {
+        return false;
+    }
+    response.status = atoi(line.c_str() + space + 1);
+    keepAlive = (line.compare(0, 8, "HTTP/1.0") != 0);
+    
+    long contentLength = -1;
+    bool chunked = false;
+    
+    while (true)
+    {
+        if (!readLine(line)) {
+            return false;
+        }
+        if (line.empty()) {
+            break;
+        }
+        
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        
+        std::string name = line.substr(0, colon);
+        size_t start = line.find_first_not_of(' ', colon + 1);
+        std::string value = (start == std::string::npos) ? std::string() : line.substr(start);
+        
+        if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+            contentLength = atol(value.c_str());
+        } else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0 && strcasecmp(value.c_str(), "chunked") == 0) {
+            chunked = true;
+        } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+            keepAlive = (strcasecmp(value.c_str(), "close") != 0);
+        } else if (strcasecmp(name.c_str(), "Content-Type") == 0) {
+            response.contentType = value;
+        }
+    }
+    
+    if (chunked)
+    {
+        while (true)
+        {
+            if (!readLine(line)) {
+                return false;
+            }
+            
+            size_t size = strtoul(line.c_str(), NULL, 16);
+            if (size == 0) {
+                // Skip any trailers, up to the blank line
+                while (readLine(line) && !line.empty()) {
+                }
+                return true;
+            }
+            
+            if (!readBytes(size, response.body) || !readLine(line)) {
+                return false;
+            }
+        }
+    }
+    
+    if (contentLength >= 0) {
+        return readBytes(contentLength, response.body);
+    }
+    
+    // No length: the body runs until the server closes the connection
+    while (fill()) {
+    }
+    response.body += _buffer;
+    _buffer.clear();
+    keepAlive = false;
+    return true;
+}
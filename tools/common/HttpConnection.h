@@ -0,0 +1,78 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Persistent HTTP/1.1 client connection
+ * One TCP connection is kept open and reused for every request, and reopened if the server drops it
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef httpconnection_h
+#define httpconnection_h
+
+#include <string>
+#include <sys/socket.h>
+
+#include "Http.h"
+
+class HttpConnection
+{
+    public:
+        HttpConnection(const std::string &host, int port, int timeoutMs = 5000);
+        ~HttpConnection(void);
+        
+        // Send one request and wait for the response. status is -1 if there was no response.
+        HttpResponse get(const std::string &path);
+        HttpResponse post(const std::string &path, const std::string &body, const std::string &contentType = "application/x-www-form-urlencoded");
+        
+        void close(void);
+        
+        // Number of TCP connections opened so far
+        long connects(void) const;
+        
+    private:
+    
+        HttpResponse request(const std::string &method, const std::string &path, const std::string &body, const std::string &contentType);
+        
+        bool open(void);
+        bool connectWithTimeout(const struct sockaddr *address, socklen_t length);
+        bool sendAll(const std::string &data);
+        bool fill(void);                            // Read more into _buffer, false on close/error/timeout
+        bool readLine(std::string &line);
+        bool readBytes(size_t count, std::string &out);
+        bool readResponse(HttpResponse &response, bool &keepAlive);
+        
+        std::string _host;
+        int _port;
+        int _timeoutMs;
+        
+        int _fd;
+        std::string _buffer;                        // Received but not yet consumed
+        bool _timedOut;
+        long _connects;
+};
+
+#endif
@@ -0,0 +1,462 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Small threaded HTTP/1.1 server, one thread per connection
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "HttpServer.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Drop connections that have been idle this long
+#define IDLE_TIMEOUT_SECS 60
+
+// Largest request we accept: bulk posts can be big
+#define MAX_REQUEST_LEN (8 * 1024 * 1024)
+
+HttpServer::HttpServer(Handler handler)
+    : _handler(handler), _listenFd(-1), _port(0), _running(false), _workers(0), _connections(0), _requests(0),
+      _blackholed(0)
+{
+    memset(&_address, 0, sizeof(_address));
+}
+
+HttpServer::~HttpServer(void)
+{
+    stop();
+}
+
+bool HttpServer::listen(const std::string &address, int port)
+{
+    memset(&_address, 0, sizeof(_address));
+    _address.sin_family = AF_INET;
+    _address.sin_port = htons(port);
+    
+    if (inet_pton(AF_INET, address.c_str(), &_address.sin_addr) != 1) {
+        return false;
+    }
+    
+    if (!openListener()) {
+        return false;
+    }
+    
+    _port = ntohs(_address.sin_port);
+    return true;
+}
+
+bool HttpServer::openListener(void)
+{
+    _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listenFd < 0) {
+        return false;
+    }
+    
+    int one = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    // Port 0 becomes the port we got, so listening again after a refusal keeps it
+    socklen_t len = sizeof(_address);
+    if (bind(_listenFd, (struct sockaddr *)&_address, sizeof(_address)) != 0 || ::listen(_listenFd, 1024) != 0 ||
+        getsockname(_listenFd, (struct sockaddr *)&_address, &len) != 0)
+    {
+        close(_listenFd);
+        _listenFd = -1;
+        return false;
+    }
+    
+    return true;
+}
+
+void HttpServer::start(void)
+{
+    _running = true;
+    _acceptThread = std::thread(&HttpServer::acceptLoop, this);
+}
+
+void HttpServer::releaseListener(void)
+{
+    if (_listenFd >= 0) {
+        close(_listenFd);
+        _listenFd = -1;
+    }
+}
+
+int HttpServer::port(void) const
+{
+    return _port;
+}
+
+void HttpServer::setAdmission(Admission admission)
+{
+    _admission = admission;
+}
+
+HttpAdmission HttpServer::admission(void) const
+{
+    return _admission ? _admission() : HTTP_ADMIT;
+}
+
+void HttpServer::stop(void)
+{
+    if (_running)
+    {
+        _running = false;
+        _acceptThread.join();
+    }
+    
+    releaseListener();
+    
+    std::unique_lock<std::mutex> lock(_mutex);
+    
+    for (std::set<int>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+        shutdown(*it, SHUT_RDWR);
+    }
+    
+    while (_workers > 0) {
+        _idle.wait(lock);
+    }
+}
+
+long HttpServer::connectionsAccepted(void) const
+{
+    return _connections;
+}
+
+long HttpServer::requestsServed(void) const
+{
+    return _requests;
+}
+
+long HttpServer::connectionsBlackholed(void) const
+{
+    return _blackholed;
+}
+
+void HttpServer::acceptLoop(void)
+{
+    // Connections accepted while black-holing: open and unanswered, until their client gives up or the hang ends
+    std::vector<int> held;
+    std::vector<struct pollfd> pfds;
+    
+    while (_running)
+    {
+        HttpAdmission now = admission();
+        
+        if (now != HTTP_BLACKHOLE) {
+            releaseHeld(held);
+        }
+        
+        // Refusing means not listening at all, so connecting fails straight away as it does with the service stopped
+        if (now == HTTP_REFUSE) {
+            releaseListener();
+            usleep(100 * 1000);
+            continue;
+        }
+        
+        if (_listenFd < 0 && !openListener()) {
+            usleep(100 * 1000);
+            continue;
+        }
+        
+        pfds.resize(1 + held.size());
+        pfds[0].fd = _listenFd;
+        for (size_t i = 0; i < held.size(); i++) {
+            pfds[i + 1].fd = held[i];
+        }
+        for (size_t i = 0; i < pfds.size(); i++) {
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+        
+        // Wake up now and then to see if we've been stopped
+        if (poll(&pfds[0], pfds.size(), 100) <= 0) {
+            continue;
+        }
+        
+        for (size_t i = held.size(); i-- > 0; )
+        {
+            if (pfds[i + 1].revents != 0 && !holdConnection(held[i]))
+            {
+                close(held[i]);
+                held.erase(held.begin() + i);
+            }
+        }
+        
+        if (!(pfds[0].revents & POLLIN)) {
+            continue;
+        }
+        
+        int fd = accept(_listenFd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        
+        _connections++;
+        
+        if (now == HTTP_BLACKHOLE)
+        {
+            _blackholed++;
+            held.push_back(fd);
+            continue;
+        }
+        
+        struct timeval timeout;
+        timeout.tv_sec = IDLE_TIMEOUT_SECS;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        
+        std::lock_guard<std::mutex> lock(_mutex);
+        _clients.insert(fd);
+        _workers++;
+        std::thread(&HttpServer::serve, this, fd).detach();
+    }
+    
+    releaseHeld(held);
+}
+
+// Reads and throws away whatever a held connection sends. False once its client has closed it.
+bool HttpServer::holdConnection(int fd)
+{
+    char chunk[4096];
+    
+    ssize_t n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+    return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
+void HttpServer::releaseHeld(std::vector<int> &held)
+{
+    for (size_t i = 0; i < held.size(); i++) {
+        close(held[i]);
+    }
+    held.clear();
+}
+
+void HttpServer::serve(int fd)
+{
+    std::string buffer;
+    bool keepAlive = true;
+    
+    while (_running && keepAlive)
+    {
+        HttpRequest request;
+        HttpResponse response;
+        
+        if (!readRequest(fd, buffer, request, keepAlive)) {
+            break;
+        }
+        
+        // The service went down under an open connection: a refusing one closes it, a hung one never answers
+        HttpAdmission now = admission();
+        if (now == HTTP_REFUSE) {
+            break;
+        }
+        if (now == HTTP_BLACKHOLE)
+        {
+            _blackholed++;
+            
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            
+            while (_running && admission() == HTTP_BLACKHOLE)
+            {
+                pfd.revents = 0;
+                if (poll(&pfd, 1, 100) == 1 && !holdConnection(fd)) {
+                    break;
+                }
+            }
+            break;
+        }
+        
+        _handler(request, response);
+        _requests++;
+        
+        if (response.close) {
+            keepAlive = false;
+        }
+        
+        // A negative status means "drop the connection without answering"
+        if (response.status < 0 || !sendResponse(fd, response, keepAlive)) {
+            break;
+        }
+    }
+    
+    close(fd);
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    _clients.erase(fd);
+    _workers--;
+    _idle.notify_all();
+}
+
+bool HttpServer::readRequest(int fd, std::string &buffer, HttpRequest &request, bool &keepAlive)
+{
+    size_t headerEnd;
+    char chunk[4096];
+    
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+    {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || buffer.size() > MAX_REQUEST_LEN) {
+            return false;
+        }
+        buffer.append(chunk, n);
+    }
+    
+    // Request line: GET /path?query HTTP/1.1
+    size_t lineEnd = buffer.find("\r\n");
+    std::string line = buffer.substr(0, lineEnd);
+    
+    size_t first = line.find(' ');
+    size_t second = line.find(' ', first + 1);
+    if (first == std::string::npos || second == std::string::npos) {
+        return false;
+    }
+    
+    request.method = line.substr(0, first);
+    std::string target = line.substr(first + 1, second - first - 1);
+    std::string version = line.substr(second + 1);
+    
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    if (question != std::string::npos) {
+        parseFormParams(target.substr(question + 1), request.params);
+    }
+    
+    // HTTP/1.0 clients (like the Photon's HttpClient) expect us to close, unless they ask otherwise
+    keepAlive = (version != "HTTP/1.0");
+    
+    size_t pos = lineEnd + 2;
+    while (pos < headerEnd)
+    {
+        size_t end = buffer.find("\r\n", pos);
+        std::string header = buffer.substr(pos, end - pos);
+        pos = end + 2;
+        
+        size_t colon = header.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        
+        std::string name = header.substr(0, colon);
+        for (size_t i = 0; i < name.size(); i++) {
+            name[i] = tolower(name[i]);
+        }
+        
+        size_t start = header.find_first_not_of(' ', colon + 1);
+        request.headers[name] = (start == std::string::npos) ? std::string() : header.substr(start);
+    }
+    
+    std::string connection = request.headers["connection"];
+    if (strcasecmp(connection.c_str(), "close") == 0) {
+        keepAlive = false;
+    } else if (strcasecmp(connection.c_str(), "keep-alive") == 0) {
+        keepAlive = true;
+    }
+    
+    size_t contentLength = strtoul(request.headers["content-length"].c_str(), NULL, 10);
+    if (contentLength > MAX_REQUEST_LEN) {
+        return false;
+    }
+    
+    buffer.erase(0, headerEnd + 4);
+    
+    while (buffer.size() < contentLength)
+    {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, n);
+    }
+    
+    request.body = buffer.substr(0, contentLength);
+    buffer.erase(0, contentLength);
+    
+    if (strncasecmp(request.headers["content-type"].c_str(), "application/x-www-form-urlencoded", 33) == 0) {
+        parseFormParams(request.body, request.params);
+    }
+    
+    return true;
+}
+
+bool HttpServer::sendResponse(int fd, const HttpResponse &response, bool keepAlive)
+{
+    const char *reason;
+    
+    switch (response.status)
+    {
+        case 200: reason = "OK"; break;
+        case 400: reason = "Bad Request"; break;
+        case 401: reason = "Unauthorized"; break;
+        case 404: reason = "Not Found"; break;
+        case 500: reason = "Internal Server Error"; break;
+        case 503: reason = "Service Unavailable"; break;
+        default:  reason = "Status"; break;
+    }
+    
+    std::string message = "HTTP/1.1 " + std::to_string(response.status) + " " + reason + "\r\n";
+    message += "Content-Type: " + (response.contentType.empty() ? std::string("text/plain") : response.contentType) + "\r\n";
+    message += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+    message += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    message += "\r\n";
+    message += response.body;
+    
+    size_t sent = 0;
+    while (sent < message.size())
+    {
+        ssize_t n = send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
@@ -0,0 +1,119 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Small threaded HTTP/1.1 server, one thread per connection
+ * Keeps connections alive between requests, so it can show whether a client really reuses its connection
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef httpserver_h
+#define httpserver_h
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+
+#include "Http.h"
+
+// How the server treats connections right now, so it can play a service that is down or hung
+enum HttpAdmission
+{
+    HTTP_ADMIT,         // Serve them
+    HTTP_REFUSE,        // Stop listening: new connections are refused, open ones are closed at their next request
+    HTTP_BLACKHOLE      // Accept them and read their requests, but never answer
+};
+
+class HttpServer
+{
+    public:
+        // Called on the connection's thread: it must be safe to call from several threads at once
+        typedef std::function<void(const HttpRequest &, HttpResponse &)> Handler;
+        
+        // Asked every tick of the accept thread, and before each request is handled
+        typedef std::function<HttpAdmission(void)> Admission;
+        
+        HttpServer(Handler handler);
+        ~HttpServer(void);
+        
+        // Bind and listen. Port 0 picks a free port: port() says which.
+        // Connections queue up until start(), which runs the accept thread: a process that forks
+        // can listen() first and start() after, so no child inherits a process with threads running.
+        bool listen(const std::string &address, int port);
+        void start(void);
+        int port(void) const;
+        
+        // For a child forked between listen() and start(): close its copy of the listening socket
+        void releaseListener(void);
+        
+        // Set before start(). Without one, every connection is admitted.
+        void setAdmission(Admission admission);
+        
+        // Closes every connection, and waits for the handlers to finish
+        void stop(void);
+        
+        long connectionsAccepted(void) const;
+        long requestsServed(void) const;
+        long connectionsBlackholed(void) const;
+        
+    private:
+    
+        bool openListener(void);
+        HttpAdmission admission(void) const;
+        void acceptLoop(void);
+        bool holdConnection(int fd);
+        void releaseHeld(std::vector<int> &held);
+        void serve(int fd);
+        bool readRequest(int fd, std::string &buffer, HttpRequest &request, bool &keepAlive);
+        bool sendResponse(int fd, const HttpResponse &response, bool keepAlive);
+        
+        Handler _handler;
+        Admission _admission;
+        struct sockaddr_in _address;    // Kept so a refusing server can listen again on the same port
+        int _listenFd;
+        int _port;
+        
+        std::atomic<bool> _running;
+        std::thread _acceptThread;
+        
+        std::mutex _mutex;
+        std::condition_variable _idle;
+        std::set<int> _clients;
+        int _workers;
+        
+        std::atomic<long> _connections;
+        std::atomic<long> _requests;
+        std::atomic<long> _blackholed;
+};
+
+#endif
@@ -0,0 +1,438 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Mock emonCMS and provisioning service, with injectable latency, errors and outages
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "MockEmon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "EnvPacket.h"
+
+// Each connection has its own thread: give each its own generator
+static double randomFraction(void)
+{
+    static thread_local std::mt19937 generator(std::random_device{}());
+    return std::uniform_real_distribution<double>(0.0, 1.0)(generator);
+}
+
+// The top level entries of a bulk data array: [[...],[...]] -> "[...]", "[...]"
+static std::vector<std::string> bulkEntries(const std::string &data)
+{
+    std::vector<std::string> entries;
+    int depth = 0;
+    bool inString = false;
+    size_t start = 0;
+    
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        char c = data[i];
+        
+        if (inString) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                inString = false;
+            }
+            continue;
+        }
+        
+        if (c == '"') {
+            inString = true;
+        } else if (c == '[' || c == '{') {
+            if (++depth == 2) {
+                start = i;
+            }
+        } else if (c == ']' || c == '}') {
+            if (depth-- == 2) {
+                entries.push_back(data.substr(start, i - start + 1));
+            }
+        }
+    }
+    return entries;
+}
+
+FaultConfig::FaultConfig(void)
+    : latencyMs(0), jitterMs(0), errorRate(0.0), dropRate(0.0)
+{
+}
+
+bool FaultConfig::parse(const std::string &spec)
+{
+    std::istringstream items(spec);
+    std::string item;
+    
+    while (std::getline(items, item, ','))
+    {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        
+        std::string name = item.substr(0, equals);
+        std::string value = item.substr(equals + 1);
+        
+        if (name == "latency") {
+            latencyMs = atoi(value.c_str());
+        } else if (name == "jitter") {
+            jitterMs = atoi(value.c_str());
+        } else if (name == "errors") {
+            errorRate = atof(value.c_str());
+        } else if (name == "drops") {
+            dropRate = atof(value.c_str());
+        } else if (name == "outage" || name == "reset" || name == "hang") {
+            size_t dash = value.find('-');
+            if (dash == std::string::npos) {
+                return false;
+            }
+            
+            Outage outage;
+            outage.from = atof(value.c_str());
+            outage.until = atof(value.c_str() + dash + 1);
+            outage.mode = (name == "outage") ? OUTAGE_REFUSE : (name == "reset") ? OUTAGE_RESET : OUTAGE_HANG;
+            outages.push_back(outage);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string FaultConfig::describe(void) const
+{
+    std::string description;
+    char item[64];
+    
+    if (latencyMs > 0 || jitterMs > 0) {
+        snprintf(item, sizeof(item), "latency %d+%dms ", latencyMs, jitterMs);
+        description += item;
+    }
+    if (errorRate > 0) {
+        snprintf(item, sizeof(item), "errors %.0f%% ", errorRate * 100);
+        description += item;
+    }
+    if (dropRate > 0) {
+        snprintf(item, sizeof(item), "drops %.0f%% ", dropRate * 100);
+        description += item;
+    }
+    for (size_t i = 0; i < outages.size(); i++)
+    {
+        const char *mode = (outages[i].mode == OUTAGE_REFUSE) ? "down" : (outages[i].mode == OUTAGE_RESET) ? "resetting" : "hung";
+        snprintf(item, sizeof(item), "%s %g-%gs ", mode, outages[i].from, outages[i].until);
+        description += item;
+    }
+    
+    if (description.empty()) {
+        return "healthy";
+    }
+    description.erase(description.size() - 1);
+    return description;
+}
+
+const Outage *FaultConfig::outageAt(double seconds) const
+{
+    for (size_t i = 0; i < outages.size(); i++)
+    {
+        if (seconds >= outages[i].from && seconds < outages[i].until) {
+            return &outages[i];
+        }
+    }
+    return NULL;
+}
+
+MockEmon::MockEmon(void)
+    : _collectorPort(ENVPACKET_COLLECTOR_PORT), _printInputs(false), _start(std::chrono::steady_clock::now())
+{
+}
+
+bool MockEmon::loadNodes(const char *fileName)
+{
+    std::ifstream file(fileName);
+    std::string line;
+    
+    if (!file) {
+        return false;
+    }
+    
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string id;
+        NodeInfo node;
+        
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        
+        if (fields >> id >> node.name >> node.apiKey) {
+            _nodes[id] = node;
+        }
+    }
+    return true;
+}
+
+void MockEmon::addNode(const std::string &deviceId, const std::string &name, const std::string &apiKey)
+{
+    NodeInfo node;
+    node.name = name;
+    node.apiKey = apiKey;
+    _nodes[deviceId] = node;
+}
+
+void MockEmon::setCollector(const std::string &host, int port)
+{
+    _collectorHost = host;
+    _collectorPort = port;
+}
+
+void MockEmon::setEmonFaults(const FaultConfig &faults)
+{
+    _emonFaults = faults;
+}
+
+void MockEmon::setProvisioningFaults(const FaultConfig &faults)
+{
+    _provisioningFaults = faults;
+}
+
+void MockEmon::setPrintInputs(bool print)
+{
+    _printInputs = print;
+}
+
+void MockEmon::start(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    _start = std::chrono::steady_clock::now();
+    _emonStats = MockStats();
+    _provisioningStats = MockStats();
+}
+
+// Seconds since start()
+double MockEmon::elapsed(void) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+}
+
+HttpAdmission MockEmon::admission(const FaultConfig &faults) const
+{
+    const Outage *outage = faults.outageAt(elapsed());
+    
+    if (outage == NULL || outage->mode == OUTAGE_RESET) {
+        return HTTP_ADMIT;
+    }
+    return (outage->mode == OUTAGE_REFUSE) ? HTTP_REFUSE : HTTP_BLACKHOLE;
+}
+
+HttpAdmission MockEmon::emonAdmission(void) const
+{
+    return admission(_emonFaults);
+}
+
+HttpAdmission MockEmon::provisioningAdmission(void) const
+{
+    return admission(_provisioningFaults);
+}
+
+// Count the request, then act out the faults. False if the request shouldn't be answered normally.
+// Any outage that gets this far, because its server doesn't act it out, is a reset.
+bool MockEmon::applyFaults(const FaultConfig &faults, MockStats &stats, HttpResponse &response)
+{
+    double now = elapsed();
+    
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        
+        size_t second = (size_t)now;
+        if (stats.perSecond.size() <= second) {
+            stats.perSecond.resize(second + 1);
+        }
+        stats.perSecond[second]++;
+        stats.requests++;
+        
+        if (faults.outageAt(now) != NULL) {
+            stats.outageDrops++;
+            response.status = -1;
+            return false;
+        }
+    }
+    
+    int delayMs = faults.latencyMs + (int)(faults.jitterMs * randomFraction());
+    if (delayMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+    }
+    
+    double roll = randomFraction();
+    
+    if (roll < faults.errorRate)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        stats.errors++;
+        response.status = 500;
+        response.body = "Error";
+        return false;
+    }
+    
+    if (roll < faults.errorRate + faults.dropRate)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        stats.drops++;
+        response.status = -1;
+        return false;
+    }
+    
+    return true;
+}
+
+bool MockEmon::knownApiKey(const std::string &apiKey) const
+{
+    for (std::map<std::string, NodeInfo>::const_iterator it = _nodes.begin(); it != _nodes.end(); ++it)
+    {
+        if (it->second.apiKey == apiKey) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MockEmon::handleEmon(const HttpRequest &request, HttpResponse &response)
+{
+    if (!applyFaults(_emonFaults, _emonStats, response)) {
+        return;
+    }
+    
+    response.status = 200;
+    
+    if (request.path != "/input/post" && request.path != "/input/bulk")
+    {
+        response.status = 404;
+        response.body = "Not found";
+        return;
+    }
+    
+    if (!knownApiKey(request.param("apikey")))
+    {
+        response.status = 401;
+        response.body = "Error: invalid apikey";
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    
+    if (request.path == "/input/post")
+    {
+        if (_printInputs) {
+            printf("input %s %s\n", request.param("node").c_str(), request.param("fulljson").c_str());
+        }
+        _emonStats.inputs++;
+    }
+    else
+    {
+        std::vector<std::string> entries = bulkEntries(request.param("data"));
+        
+        for (size_t i = 0; i < entries.size() && _printInputs; i++) {
+            printf("bulk %s\n", entries[i].c_str());
+        }
+        _emonStats.inputs += entries.size();
+    }
+    
+    if (_printInputs) {
+        fflush(stdout);
+    }
+    response.body = "ok";
+}
+
+void MockEmon::handleProvisioning(const HttpRequest &request, HttpResponse &response)
+{
+    if (!applyFaults(_provisioningFaults, _provisioningStats, response)) {
+        return;
+    }
+    
+    response.status = 200;
+    response.contentType = "application/json";
+    
+    if (request.path != "/api/v1/nodes/" && request.path != "/api/v1/nodes")
+    {
+        response.status = 404;
+        response.body = "{\"error\":\"not found\"}";
+        return;
+    }
+    
+    std::string id = request.param("id");
+    std::map<std::string, NodeInfo>::const_iterator node = _nodes.find(id);
+    
+    if (node == _nodes.end()) {
+        response.status = 404;
+        response.body = "{\"error\":\"unknown device\"}";
+        return;
+    }
+    
+    response.body = "{\"id\":\"" + jsonEscape(id) + "\",\"name\":\"" + jsonEscape(node->second.name) + "\",\"apikey\":\"" + jsonEscape(node->second.apiKey) + "\"";
+    if (!_collectorHost.empty()) {
+        response.body += ",\"collector\":\"" + _collectorHost + "\",\"collectorPort\":" + std::to_string(_collectorPort);
+    }
+    response.body += "}";
+    
+    std::lock_guard<std::mutex> lock(_mutex);
+    _provisioningStats.inputs++;
+}
+
+void MockEmon::handle(const HttpRequest &request, HttpResponse &response)
+{
+    if (request.path.compare(0, 4, "/api") == 0) {
+        handleProvisioning(request, response);
+    } else {
+        handleEmon(request, response);
+    }
+}
+
+size_t MockEmon::nodeCount(void) const
+{
+    return _nodes.size();
+}
+
+MockStats MockEmon::emonStats(void) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _emonStats;
+}
+
+MockStats MockEmon::provisioningStats(void) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _provisioningStats;
+}
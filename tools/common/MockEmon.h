@@ -0,0 +1,156 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Mock emonCMS and provisioning service, with injectable latency, errors and outages
+ * Used by emon-standin, and by emon-loadgen for capacity testing
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef mockemon_h
+#define mockemon_h
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Http.h"
+#include "HttpServer.h"
+
+// How a service is down
+enum OutageMode
+{
+    OUTAGE_REFUSE,              // Not running: connections are refused
+    OUTAGE_RESET,               // Up but failing: requests are read, then the connection is closed unanswered
+    OUTAGE_HANG                 // Hung: connections are accepted and never answered
+};
+
+struct Outage
+{
+    double from;                // Seconds after start()
+    double until;
+    OutageMode mode;
+};
+
+// What a mocked service does wrong. Written as "latency=200,jitter=100,errors=0.05,drops=0.01,outage=60-90",
+// with outages as outage= (refused), reset= or hang=
+struct FaultConfig
+{
+    FaultConfig(void);
+    
+    int latencyMs;              // Added to every answer
+    int jitterMs;               // Plus up to this much more, at random
+    double errorRate;           // Fraction answered 500
+    double dropRate;            // Fraction where the connection is dropped without an answer
+    std::vector<Outage> outages;
+    
+    bool parse(const std::string &spec);
+    std::string describe(void) const;
+    
+    // The outage at this many seconds after start(), or NULL if the service is up
+    const Outage *outageAt(double seconds) const;
+};
+
+struct MockStats
+{
+    MockStats(void) : requests(0), errors(0), drops(0), outageDrops(0), inputs(0) {}
+    
+    long requests;
+    long errors;
+    long drops;
+    long outageDrops;           // Requests read while the service was down, and closed unanswered
+    long inputs;                // Reading sets stored (emonCMS) or nodes provisioned (provisioning service)
+    std::vector<long> perSecond;    // Requests arriving in each second after start()
+};
+
+class MockEmon
+{
+    public:
+        MockEmon(void);
+        
+        // Nodes the provisioning service knows: a line per node of <device id> <emon name> <api key>
+        bool loadNodes(const char *fileName);
+        void addNode(const std::string &deviceId, const std::string &name, const std::string &apiKey);
+        
+        // Tell nodes to use a LAN collector
+        void setCollector(const std::string &host, int port);
+        
+        void setEmonFaults(const FaultConfig &faults);
+        void setProvisioningFaults(const FaultConfig &faults);
+        
+        // Print every input stored on stdout
+        void setPrintInputs(bool print);
+        
+        // Outage times and per second counts are measured from here
+        void start(void);
+        
+        // emonCMS: /input/post and /input/bulk
+        void handleEmon(const HttpRequest &request, HttpResponse &response);
+        // Provisioning service: /api/v1/nodes/?id=
+        void handleProvisioning(const HttpRequest &request, HttpResponse &response);
+        // Either, by path: for running both services on one port
+        void handle(const HttpRequest &request, HttpResponse &response);
+        
+        // For HttpServer::setAdmission(): refused and hung outages are acted out by the server itself.
+        // Both services on one port follow the emonCMS outages; provisioning outages there are resets.
+        HttpAdmission emonAdmission(void) const;
+        HttpAdmission provisioningAdmission(void) const;
+        
+        size_t nodeCount(void) const;
+        MockStats emonStats(void) const;
+        MockStats provisioningStats(void) const;
+        
+    private:
+    
+        struct NodeInfo
+        {
+            std::string name;
+            std::string apiKey;
+        };
+        
+        double elapsed(void) const;
+        HttpAdmission admission(const FaultConfig &faults) const;
+        bool applyFaults(const FaultConfig &faults, MockStats &stats, HttpResponse &response);
+        bool knownApiKey(const std::string &apiKey) const;
+        
+        std::map<std::string, NodeInfo> _nodes;         // By device ID
+        std::string _collectorHost;
+        int _collectorPort;
+        
+        FaultConfig _emonFaults;
+        FaultConfig _provisioningFaults;
+        bool _printInputs;
+        
+        std::chrono::steady_clock::time_point _start;
+        
+        mutable std::mutex _mutex;
+        MockStats _emonStats;
+        MockStats _provisioningStats;
+};
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * envsend: sends one reading datagram the way a node in collector mode does
+ *
+ * Usage: envsend --id DEVICEID [--name NAME] [--to HOST[:PORT]] [--boot N] [--seq N] [--repeat N] [--ack-wait MS]
+ *                key=value ...
+ *
+ * e.g. envsend --id 0123456789abcdef01234567 --seq 7 encTemp=21.5 pressure=1013.25 humidity=48
+ *
+ * With --ack-wait, waits that long for the collector's acknowledgement, prints it, and fails if none comes
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <string>
+
+#include "EnvPacket.h"
+#include "Http.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: envsend --id DEVICEID [--name NAME] [--to HOST[:PORT]] [--boot N] [--seq N] [--repeat N] [--ack-wait MS]\n"
+                    "               key=value ...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    std::string host = "127.0.0.1";
+    int port = ENVPACKET_COLLECTOR_PORT;
+    int repeat = 1;
+    int ackWaitMs = -1;
+    bool haveId = false;
+    
+    EnvPacket packet;
+    memset(&packet, 0, sizeof(packet));
+    
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        size_t equals = arg.find('=');
+        
+        if (arg.compare(0, 2, "--") != 0 && equals != std::string::npos)
+        {
+            // key=value reading
+            uint8_t key = envPacketKeyId(arg.substr(0, equals).c_str());
+            
+            if (key == ENVPACKET_KEY_UNKNOWN || packet.count == ENVPACKET_MAX_READINGS) {
+                fprintf(stderr, "Can't send %s\n", arg.c_str());
+                return 1;
+            }
+            
+            packet.readings[packet.count].key = key;
+            packet.readings[packet.count].value = envPacketToFixed(strtof(arg.c_str() + equals + 1, NULL));
+            packet.count++;
+            continue;
+        }
+        
+        if (i + 1 >= argc) {
+            usage();
+        }
+        std::string value = argv[++i];
+        
+        if (arg == "--id") {
+            haveId = envPacketParseDeviceId(value.c_str(), packet.deviceId);
+            if (!haveId) {
+                fprintf(stderr, "Device IDs are 24 hex digits\n");
+                return 1;
+            }
+        } else if (arg == "--name") {
+            // The node's cloud name: without one, the collector uses the name the provisioning service has
+            if (value.size() > ENVPACKET_MAX_NAME_LEN) {
+                fprintf(stderr, "Names are up to %d characters\n", ENVPACKET_MAX_NAME_LEN);
+                return 1;
+            }
+            strcpy(packet.name, value.c_str());
+        } else if (arg == "--to") {
+            splitHostPort(value, host, port);
+        } else if (arg == "--boot") {
+            packet.bootId = strtoul(value.c_str(), NULL, 0);
+        } else if (arg == "--seq") {
+            packet.sequence = strtoul(value.c_str(), NULL, 0);
+        } else if (arg == "--repeat") {
+            repeat = atoi(value.c_str());
+        } else if (arg == "--ack-wait") {
+            ackWaitMs = atoi(value.c_str());
+        } else {
+            usage();
+        }
+    }
+    
+    if (!haveId) {
+        usage();
+    }
+    
+    struct addrinfo hints;
+    struct addrinfo *address = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &address) != 0) {
+        fprintf(stderr, "Can't resolve %s\n", host.c_str());
+        return 1;
+    }
+    
+    uint8_t buffer[ENVPACKET_MAX_LEN];
+    size_t len = envPacketEncode(packet, buffer, sizeof(buffer));
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    
+    for (int i = 0; i < repeat; i++)
+    {
+        if (sendto(fd, buffer, len, 0, address->ai_addr, address->ai_addrlen) != (ssize_t)len) {
+            perror("sendto");
+            return 1;
+        }
+    }
+    
+    freeaddrinfo(address);
+    
+    if (ackWaitMs >= 0)
+    {
+        struct pollfd pfd;
+        uint8_t ack[ENVPACKET_ACK_LEN + 1];
+        uint32_t ackBoot;
+        uint32_t ackSequence;
+        
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        
+        // One ack per datagram sent: the last one has the news
+        bool acked = false;
+        while (poll(&pfd, 1, acked ? 0 : ackWaitMs) == 1)
+        {
+            ssize_t ackLen = recv(fd, ack, sizeof(ack), 0);
+            if (ackLen > 0 && envPacketDecodeAck(ack, ackLen, ackBoot, ackSequence)) {
+                acked = true;
+            }
+        }
+        
+        if (!acked) {
+            fprintf(stderr, "No ack\n");
+            close(fd);
+            return 3;
+        }
+        printf("ack boot %u seq %u\n", ackBoot, ackSequence);
+    }
+    
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * What a load generator scenario did, and the report on it
+ *
+ * Synchrony is the phase coherence of request start times over the timer period that drives them:
+ * R = |mean(exp(2 pi i t / period))|, 1 when every node hits the server at the same point in the cycle, near 0 when spread evenly
+ * The busiest tenth is the share of requests landing in the busiest tenth of the cycle: 10% if spread evenly, 100% in lockstep
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LoadReport.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+struct Summary
+{
+    double emonRate;
+    long emonPeak;
+    double provisioningRate;
+    long provisioningPeak;
+    
+    long posts;
+    long failedPosts;
+    double p50Ms, p90Ms, p99Ms, maxMs;
+    
+    long provisionAttempts;
+    long provisionFailures;
+    
+    Synchrony postSync;
+    Synchrony provisionSync;
+    
+    long generated;                     // Reading sets taken
+    long stored;                        // Reading sets emonCMS has
+    long unreported;                    // Never posted: node not provisioned
+    long missed;                        // Never taken: node busy posting
+    long publishes;                     // Particle.publish() calls, from every node
+    double publishesPerCycle;           // ... per node, per measurement period of the run
+    long storedDespiteFailure;          // The node gave up, but the server had it
+};
+
+double percentile(const std::vector<double> &sorted, double fraction)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+Synchrony synchrony(const std::vector<int64_t> &startsUs, int64_t periodUs)
+{
+    Synchrony sync;
+    double sumCos = 0, sumSin = 0;
+    long bins[10] = { 0 };
+    
+    for (size_t i = 0; i < startsUs.size(); i++)
+    {
+        double phase = (double)(startsUs[i] % periodUs) / periodUs;
+        
+        sumCos += cos(2 * M_PI * phase);
+        sumSin += sin(2 * M_PI * phase);
+        bins[std::min(9, (int)(phase * 10))]++;
+    }
+    
+    sync.count = startsUs.size();
+    if (sync.count > 0) {
+        sync.coherence = sqrt(sumCos * sumCos + sumSin * sumSin) / sync.count;
+        sync.busiestTenth = (double)*std::max_element(bins, bins + 10) / sync.count;
+    }
+    return sync;
+}
+
+static long peak(const std::vector<long> &perSecond)
+{
+    return perSecond.empty() ? 0 : *std::max_element(perSecond.begin(), perSecond.end());
+}
+
+static Summary summarise(const ScenarioResult &result)
+{
+    Summary summary = Summary();
+    std::vector<double> latencies;
+    std::vector<int64_t> postStarts;
+    std::vector<int64_t> provisionStarts;
+    long okPosts = 0;
+    
+    for (size_t i = 0; i < result.events.size(); i++)
+    {
+        const SimEvent &event = result.events[i];
+        int64_t start = event.startUs - result.startUs;
+        
+        switch (event.kind)
+        {
+            case SIM_POST:
+                summary.posts++;
+                okPosts += event.ok;
+                latencies.push_back(event.durationUs / 1000.0);
+                postStarts.push_back(start);
+                break;
+                
+            case SIM_PROVISION:
+                summary.provisionAttempts++;
+                summary.provisionFailures += !event.ok;
+                provisionStarts.push_back(start);
+                break;
+                
+            case SIM_UNREPORTED:
+                summary.unreported++;
+                break;
+                
+            case SIM_MISSED:
+                summary.missed += event.count;
+                break;
+                
+            case SIM_PUBLISHES:
+                summary.publishes += event.count;
+                break;
+        }
+    }
+    
+    std::sort(latencies.begin(), latencies.end());
+    summary.failedPosts = summary.posts - okPosts;
+    summary.p50Ms = percentile(latencies, 0.50);
+    summary.p90Ms = percentile(latencies, 0.90);
+    summary.p99Ms = percentile(latencies, 0.99);
+    summary.maxMs = latencies.empty() ? 0 : latencies.back();
+    
+    summary.postSync = synchrony(postStarts, result.config.measureMs * 1000LL);
+    summary.provisionSync = synchrony(provisionStarts, result.config.provisionMs * 1000LL);
+    
+    summary.emonRate = result.emon.requests / result.seconds;
+    summary.emonPeak = peak(result.emon.perSecond);
+    summary.provisioningRate = result.provisioning.requests / result.seconds;
+    summary.provisioningPeak = peak(result.provisioning.perSecond);
+    
+    double cycles = result.nodes * result.seconds * 1000.0 / result.config.measureMs;
+    summary.publishesPerCycle = cycles > 0 ? summary.publishes / cycles : 0;
+    
+    summary.generated = summary.posts + summary.unreported + summary.missed;
+    summary.stored = result.emon.inputs;
+    summary.storedDespiteFailure = std::max(0L, summary.stored - okPosts);
+    
+    return summary;
+}
+
+void printReport(const ScenarioResult &result)
+{
+    Summary s = summarise(result);
+    long lost = std::max(0L, s.generated - s.stored);
+    
+    printf("Scenario %s: emonCMS %s, provisioning %s\n", result.name.c_str(), result.emonFaults.describe().c_str(), result.provisioningFaults.describe().c_str());
+    printf("  %d nodes for %.0fs, measuring every %.1fs, provisioning retry every %.1fs, boots spread over %.1fs\n",
+           result.nodes, result.seconds, result.config.measureMs / 1000.0, result.config.provisionMs / 1000.0, result.config.staggerMs / 1000.0);
+    printf("  server        emonCMS %ld requests, %.1f/s, peak %ld/s; provisioning %ld requests, %.1f/s, peak %ld/s\n",
+           result.emon.requests, s.emonRate, s.emonPeak, result.provisioning.requests, s.provisioningRate, s.provisioningPeak);
+    printf("                (emonCMS answered %ld with errors, dropped %ld, reset %ld while down, and left %ld hanging)\n",
+           result.emon.errors, result.emon.drops, result.emon.outageDrops, result.emonBlackholed);
+    printf("  post latency  p50 %.1fms, p90 %.1fms, p99 %.1fms, max %.1fms over %ld posts (%ld failed)\n",
+           s.p50Ms, s.p90Ms, s.p99Ms, s.maxMs, s.posts, s.failedPosts);
+    printf("  provisioning  %ld attempts, %ld failed\n", s.provisionAttempts, s.provisionFailures);
+    printf("  publishes     %ld, %.1f per node per measurement cycle\n", s.publishes, s.publishesPerCycle);
+    printf("  synchrony     posts R %.2f, busiest tenth %.0f%%; provisioning retries R %.2f, busiest tenth %.0f%%\n",
+           s.postSync.coherence, s.postSync.busiestTenth * 100, s.provisionSync.coherence, s.provisionSync.busiestTenth * 100);
+    printf("  data          %ld reading sets due, %ld stored, %ld lost (%.1f%%): %ld never posted while unprovisioned, %ld never taken while busy\n",
+           s.generated, s.stored, lost, s.generated ? 100.0 * lost / s.generated : 0.0, s.unreported, s.missed);
+    if (s.storedDespiteFailure > 0) {
+        printf("                %ld stored although the node saw the post fail\n", s.storedDespiteFailure);
+    }
+    printf("\n");
+}
+
+void printSummary(const std::vector<ScenarioResult> &results)
+{
+    printf("%-22s %10s %10s %10s %10s %8s %8s %8s\n", "scenario", "emon req/s", "peak/s", "p50 ms", "p99 ms", "post R", "retry R", "lost");
+    
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        Summary s = summarise(results[i]);
+        long lost = std::max(0L, s.generated - s.stored);
+        
+        printf("%-22s %10.1f %10ld %10.1f %10.1f %8.2f %8.2f %7.1f%%\n", results[i].name.c_str(), s.emonRate, s.emonPeak, s.p50Ms, s.p99Ms,
+               s.postSync.coherence, s.provisionSync.coherence, s.generated ? 100.0 * lost / s.generated : 0.0);
+    }
+}
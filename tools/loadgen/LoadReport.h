@@ -0,0 +1,81 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * What a load generator scenario did, and the report on it
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef loadreport_h
+#define loadreport_h
+
+#include <string>
+#include <vector>
+
+#include "MockEmon.h"
+#include "SimNode.h"
+
+struct ScenarioResult
+{
+    std::string name;
+    FaultConfig emonFaults;
+    FaultConfig provisioningFaults;
+    
+    int nodes;
+    double seconds;
+    SimConfig config;
+    
+    int64_t startUs;                    // CLOCK_MONOTONIC, when the nodes were let go
+    std::vector<SimEvent> events;       // From every node
+    
+    MockStats emon;                     // What the mocks saw
+    MockStats provisioning;
+    long emonBlackholed;                // Connections and requests the emonCMS server never answered while hung
+};
+
+// How bunched up a set of start times is, by their phase within a period. Coherence (R) is 1 when they all
+// fall at the same phase and near 0 when spread evenly; busiestTenth is the share in the busiest tenth of the period.
+struct Synchrony
+{
+    Synchrony(void) : count(0), coherence(0), busiestTenth(0) {}
+    
+    long count;
+    double coherence;
+    double busiestTenth;
+};
+
+Synchrony synchrony(const std::vector<int64_t> &startsUs, int64_t periodUs);
+
+// The value fraction of the way up sorted (clamped to the last), or 0 if there are none
+double percentile(const std::vector<double> &sorted, double fraction);
+
+// Detail for one scenario
+void printReport(const ScenarioResult &result);
+
+// A line per scenario
+void printSummary(const std::vector<ScenarioResult> &results);
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * One simulated node: the real EmonLink and EnvNode, driven the way emonnode.ino drives them
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "SimNode.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "NodeCycle.h"
+
+// The sketch's node type: a fixed sensor set build if ENVNODE_SENSORS is defined (emon-loadgen-fixed)
+#ifdef ENVNODE_SENSORS
+typedef FixedEnvNode SimEnvNode;
+#else
+typedef EnvNode SimEnvNode;
+#endif
+
+int64_t simMonotonicUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+std::string simNodeName(int index)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "sim%05d", index);
+    return name;
+}
+
+std::string simNodeDeviceId(int index)
+{
+    char id[32];
+    snprintf(id, sizeof(id), "5e%022x", index);
+    return id;
+}
+
+// A Particle software timer: fires every period from start(), and firings missed while loop() is busy collapse into one flag
+class SimTimer
+{
+    public:
+        SimTimer(int periodMs) : _periodUs(periodMs * 1000LL), _running(false), _next(0), _fired(false) {}
+        
+        void start(int64_t now) { _running = true; _next = now + _periodUs; }
+        void stop(void) { _running = false; }
+        
+        int64_t next(void) const { return _running ? _next : INT64_MAX; }
+        
+        // Like the timer callback setting the loop flag. Returns how many times it fired.
+        int update(int64_t now)
+        {
+            if (!_running || now < _next) {
+                return 0;
+            }
+            
+            int firings = (now - _next) / _periodUs + 1;
+            _fired = true;
+            _next += firings * _periodUs;
+            return firings;
+        }
+        
+        bool take(void)
+        {
+            bool fired = _fired;
+            _fired = false;
+            return fired;
+        }
+        
+    private:
+        int64_t _periodUs;
+        bool _running;
+        int64_t _next;
+        bool _fired;
+};
+
+static void report(int eventFd, int index, SimEventKind kind, bool ok, int64_t startUs, int64_t endUs, uint32_t count = 1)
+{
+    SimEvent event;
+    
+    event.node = index;
+    event.kind = kind;
+    event.ok = ok;
+    event.startUs = startUs;
+    event.durationUs = endUs - startUs;
+    event.count = count;
+    
+    if (write(eventFd, &event, sizeof(event)) != sizeof(event)) {
+        perror("event pipe");
+    }
+}
+
+// Times each post the shared cycle makes, and reports it
+class SimPostObserver
+{
+    public:
+        SimPostObserver(int eventFd, int index) : _eventFd(eventFd), _index(index), _startUs(0) {}
+        
+        void postStarted(void)
+        {
+            _startUs = simMonotonicUs();
+        }
+        
+        void postFinished(bool ok)
+        {
+            report(_eventFd, _index, SIM_POST, ok, _startUs, simMonotonicUs());
+        }
+        
+        void postSkipped(void)
+        {
+            int64_t now = simMonotonicUs();
+            report(_eventFd, _index, SIM_UNREPORTED, false, now, now);
+        }
+        
+    private:
+        int _eventFd;
+        int _index;
+        int64_t _startUs;
+};
+
+// setup() and loop() from the sketch, with SimTimers for the Particle timers. The cycle itself is the sketch's own (NodeCycle.h).
+void runSimNode(int index, const SimConfig &config, int64_t endUs, int eventFd)
+{
+    std::mt19937 generator(index);
+    
+    simDevice.deviceId = simNodeDeviceId(index);
+    simDevice.bmeFitted = config.bme;
+    simDevice.ds18Fitted = config.ds18;
+    simDevice.baseTemp = std::uniform_real_distribution<double>(15.0, 25.0)(generator);
+    
+    if (config.staggerMs > 0) {
+        usleep(std::uniform_int_distribution<int>(0, config.staggerMs)(generator) * 1000LL);
+    }
+    
+    // setup()
+    SimEnvNode envNode;
+    EmonLink emonLink(String(config.host));
+    NodeState nodeState;
+    SimPostObserver observer(eventFd, index);
+    SimTimer sensorInitTimer(config.sensorInitMs);
+    SimTimer provisioningTimer(config.provisionMs);
+    SimTimer measurementTimer(config.measureMs);
+    
+    std::string name = simNodeName(index);
+    std::vector<char> devName(name.begin(), name.end());
+    devName.push_back('\0');
+    emonLink.setCloudDeviceName(devName.data());
+    
+    envNode.initSensors();
+    
+    int64_t now = simMonotonicUs();
+    provisioningTimer.start(now);
+    measurementTimer.start(now);
+    
+    if (!envNode.allSensorsFound()) {
+        sensorInitTimer.start(now);
+    }
+    
+    // loop()
+    while (true)
+    {
+        int64_t wake = std::min(std::min(sensorInitTimer.next(), provisioningTimer.next()), std::min(measurementTimer.next(), endUs));
+        now = simMonotonicUs();
+        if (wake > now) {
+            usleep(wake - now);
+        }
+        
+        now = simMonotonicUs();
+        if (now >= endUs) {
+            break;
+        }
+        
+        sensorInitTimer.update(now);
+        provisioningTimer.update(now);
+        
+        int measurements = measurementTimer.update(now);
+        if (measurements > 1) {
+            report(eventFd, index, SIM_MISSED, false, now, now, (measurements - 1) * nodePostsPerCycle(envNode));
+        }
+        
+        if (sensorInitTimer.take() && nodeSearchSensors(envNode)) {
+            sensorInitTimer.stop();
+        }
+        
+        if (provisioningTimer.take())
+        {
+            int64_t start = simMonotonicUs();
+            bool ok = nodeProvision(envNode, emonLink);
+            report(eventFd, index, SIM_PROVISION, ok, start, simMonotonicUs());
+            
+            if (ok) {
+                provisioningTimer.stop();
+            }
+        }
+        
+        if (measurementTimer.take() && nodeMeasure(envNode, emonLink, nodeState, observer)) {
+            provisioningTimer.start(simMonotonicUs());
+        }
+    }
+    
+    now = simMonotonicUs();
+    report(eventFd, index, SIM_PUBLISHES, true, now, now, simDevice.publishes);
+}
@@ -0,0 +1,85 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * One simulated node: the real EmonLink and EnvNode, driven the way emonnode.ino drives them
+ * Runs in its own process, and reports what it did to the load generator as SimEvents down a pipe
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef simnode_h
+#define simnode_h
+
+#include <stdint.h>
+#include <string>
+
+struct SimConfig
+{
+    SimConfig(void) : measureMs(30000), provisionMs(10000), sensorInitMs(20000), staggerMs(0), bme(true), ds18(true) {}
+    
+    // The firmware's timer periods
+    int measureMs;
+    int provisionMs;
+    int sensorInitMs;
+    
+    int staggerMs;              // Nodes boot at random over this long. 0: all at once, as after a power cut.
+    
+    bool bme;
+    bool ds18;
+    
+    std::string host;           // emonpi address
+};
+
+enum SimEventKind
+{
+    SIM_PROVISION,              // A provisioning attempt
+    SIM_POST,                   // A reading set posted
+    SIM_UNREPORTED,             // A reading set taken while not provisioned: the firmware doesn't post it
+    SIM_MISSED,                 // Reading sets never taken: loop() was still busy when the measurement timer fired again
+    SIM_PUBLISHES               // Particle.publish() calls the node made, reported once at the end
+};
+
+// Small enough that each write to the pipe is atomic
+struct SimEvent
+{
+    uint32_t node;
+    uint8_t kind;
+    uint8_t ok;
+    int64_t startUs;            // CLOCK_MONOTONIC
+    int64_t durationUs;
+    uint32_t count;             // SIM_MISSED: how many reading sets. SIM_PUBLISHES: how many publishes.
+};
+
+// Name and device ID for node index
+std::string simNodeName(int index);
+std::string simNodeDeviceId(int index);
+
+// Run node index until endUs (CLOCK_MONOTONIC), writing events to eventFd
+void runSimNode(int index, const SimConfig &config, int64_t endUs, int eventFd);
+
+int64_t simMonotonicUs(void);
+
+#endif
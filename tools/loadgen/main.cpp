@@ -0,0 +1,355 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * emon-loadgen: runs a fleet of simulated nodes, built from the real EmonLink and EnvNode, against a mock emonCMS
+ * and mock provisioning service, to see how many nodes an emonpi can take and how the firmware copes when it struggles
+ *
+ * Usage: emon-loadgen [--nodes N] [--duration SECS] [--scenario NAME|all] [--measure-ms N] [--provision-ms N]
+ *                     [--stagger-ms N] [--sensors both|bme|ds18] [--faults SPEC] [--provisioning-faults SPEC]
+ *                     [--emon-port N] [--provisioning-port N] [--collector HOST[:PORT]]
+ *
+ * Scenarios: healthy, slow, flaky, outage, hung, provisioning-outage. --faults/--provisioning-faults replace the scenario's own.
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EnvPacket.h"
+#include "HttpServer.h"
+#include "LoadReport.h"
+#include "MockEmon.h"
+#include "SimNode.h"
+#include "SimDevice.h"
+
+#define SIM_API_KEY "loadgen"
+
+struct Scenario
+{
+    const char *name;
+    const char *emonFaults;             // Times are fractions of the run, turned into seconds below
+    const char *provisioningFaults;
+};
+
+static const Scenario scenarios[] =
+{
+    { "healthy",             "",                                 "" },
+    { "slow",                "latency=1500,jitter=5000",         "" },     // Some posts outlast the firmware's 5s timeout
+    { "flaky",               "errors=0.1,drops=0.05",            "" },
+    { "outage",              "outage=0.3-0.6",                   "" },     // Connections refused
+    { "hung",                "hang=0.3-0.6",                     "" },     // Connections accepted, never answered
+    { "provisioning-outage", "",                                 "outage=0-0.5" },     // Every node retrying together
+};
+
+struct Options
+{
+    Options(void) : nodes(200), seconds(120), emonPort(0), provisioningPort(0), collectorPort(ENVPACKET_COLLECTOR_PORT) {}
+    
+    int nodes;
+    double seconds;
+    SimConfig config;
+    std::vector<std::string> scenarios;
+    std::string emonFaults;
+    std::string provisioningFaults;
+    int emonPort;
+    int provisioningPort;
+    std::string collectorHost;
+    int collectorPort;
+};
+
+// Outage times in the presets are fractions of the run
+static FaultConfig scaledFaults(const char *spec, double seconds)
+{
+    FaultConfig faults;
+    
+    faults.parse(spec);
+    for (size_t i = 0; i < faults.outages.size(); i++) {
+        faults.outages[i].from *= seconds;
+        faults.outages[i].until *= seconds;
+    }
+    return faults;
+}
+
+static bool runScenario(const Options &options, const std::string &name, const FaultConfig &emonFaults, const FaultConfig &provisioningFaults, ScenarioResult &result)
+{
+    MockEmon mock;
+    
+    for (int i = 0; i < options.nodes; i++) {
+        mock.addNode(simNodeDeviceId(i), simNodeName(i), SIM_API_KEY);
+    }
+    if (!options.collectorHost.empty()) {
+        mock.setCollector(options.collectorHost, options.collectorPort);
+    }
+    mock.setEmonFaults(emonFaults);
+    mock.setProvisioningFaults(provisioningFaults);
+    
+    HttpServer emonServer([&mock](const HttpRequest &request, HttpResponse &response) { mock.handleEmon(request, response); });
+    HttpServer provisioningServer([&mock](const HttpRequest &request, HttpResponse &response) { mock.handleProvisioning(request, response); });
+    emonServer.setAdmission([&mock](void) { return mock.emonAdmission(); });
+    provisioningServer.setAdmission([&mock](void) { return mock.provisioningAdmission(); });
+    
+    // Bind now, so the nodes know the ports, but don't start the servers' threads until every node is forked
+    if (!emonServer.listen("127.0.0.1", options.emonPort) || !provisioningServer.listen("127.0.0.1", options.provisioningPort))
+    {
+        fprintf(stderr, "Can't start the mock servers\n");
+        return false;
+    }
+    
+    // The nodes think they're talking to the emonpi's usual ports
+    simDevice.portMap[80] = emonServer.port();
+    simDevice.portMap[5000] = provisioningServer.port();
+    
+    // Nodes report down events; they all wait on start until we close it, so every fork is done before any connection is made
+    // (a node forked later would otherwise inherit, and hold open, connections the servers had accepted)
+    int events[2];
+    int start[2];
+    
+    if (pipe(events) != 0 || pipe(start) != 0) {
+        perror("pipe");
+        return false;
+    }
+    
+    SimConfig config = options.config;
+    config.host = "127.0.0.1";
+    
+    int64_t endUs = simMonotonicUs() + (int64_t)(options.seconds * 1e6) + config.staggerMs * 1000LL + 60 * 1000000LL;
+    std::vector<pid_t> children;
+    
+    fflush(stdout);
+    fflush(stderr);
+    
+    for (int i = 0; i < options.nodes; i++)
+    {
+        pid_t pid = fork();
+        
+        if (pid < 0) {
+            perror("fork");
+            break;
+        }
+        
+        if (pid == 0)
+        {
+            close(events[0]);
+            close(start[1]);
+            emonServer.releaseListener();
+            provisioningServer.releaseListener();
+            
+            // Our run time starts when we're let go
+            int64_t go;
+            if (read(start[0], &go, sizeof(go)) != 0) {
+                _exit(1);
+            }
+            close(start[0]);
+            
+            runSimNode(i, config, simMonotonicUs() + (int64_t)(options.seconds * 1e6), events[1]);
+            _exit(0);
+        }
+        
+        children.push_back(pid);
+    }
+    
+    close(events[1]);
+    close(start[0]);
+    
+    std::vector<SimEvent> received;
+    std::thread reader([&received, &events]() {
+        SimEvent event;
+        while (read(events[0], &event, sizeof(event)) == sizeof(event)) {
+            received.push_back(event);
+        }
+    });
+    
+    fprintf(stderr, "%s: %zu nodes running for %.0fs\n", name.c_str(), children.size(), options.seconds);
+    
+    emonServer.start();
+    provisioningServer.start();
+    mock.start();
+    result.startUs = simMonotonicUs();
+    close(start[1]);
+    
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        int status;
+        
+        // Nodes stop by themselves: if any are stuck long after, stop them
+        while (waitpid(children[i], &status, WNOHANG) == 0)
+        {
+            if (simMonotonicUs() > endUs) {
+                kill(children[i], SIGKILL);
+            }
+            usleep(100000);
+        }
+    }
+    
+    reader.join();
+    close(events[0]);
+    
+    emonServer.stop();
+    provisioningServer.stop();
+    
+    result.name = name;
+    result.emonFaults = emonFaults;
+    result.provisioningFaults = provisioningFaults;
+    result.nodes = children.size();
+    result.seconds = options.seconds;
+    result.config = config;
+    result.events.swap(received);
+    result.emon = mock.emonStats();
+    result.provisioning = mock.provisioningStats();
+    result.emonBlackholed = emonServer.connectionsBlackholed();
+    
+    return !children.empty();
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: emon-loadgen [--nodes N] [--duration SECS] [--scenario NAME|all] [--measure-ms N] [--provision-ms N]\n"
+                    "                    [--stagger-ms N] [--sensors both|bme|ds18] [--faults SPEC] [--provisioning-faults SPEC]\n"
+                    "                    [--emon-port N] [--provisioning-port N] [--collector HOST[:PORT]]\n");
+    fprintf(stderr, "Scenarios:");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        fprintf(stderr, " %s", scenarios[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        
+        if (i + 1 >= argc) {
+            usage();
+        }
+        std::string value = argv[++i];
+        
+        if (arg == "--nodes") {
+            options.nodes = atoi(value.c_str());
+        } else if (arg == "--duration") {
+            options.seconds = atof(value.c_str());
+        } else if (arg == "--scenario") {
+            options.scenarios.push_back(value);
+        } else if (arg == "--measure-ms") {
+            options.config.measureMs = atoi(value.c_str());
+        } else if (arg == "--provision-ms") {
+            options.config.provisionMs = atoi(value.c_str());
+        } else if (arg == "--stagger-ms") {
+            options.config.staggerMs = atoi(value.c_str());
+        } else if (arg == "--sensors") {
+            options.config.bme = (value == "both" || value == "bme");
+            options.config.ds18 = (value == "both" || value == "ds18");
+        } else if (arg == "--faults") {
+            options.emonFaults = value;
+        } else if (arg == "--provisioning-faults") {
+            options.provisioningFaults = value;
+        } else if (arg == "--emon-port") {
+            options.emonPort = atoi(value.c_str());
+        } else if (arg == "--provisioning-port") {
+            options.provisioningPort = atoi(value.c_str());
+        } else if (arg == "--collector") {
+            splitHostPort(value, options.collectorHost, options.collectorPort);
+        } else {
+            usage();
+        }
+    }
+    
+    if (options.nodes <= 0 || options.seconds <= 0 || options.config.measureMs <= 0 || options.config.provisionMs <= 0 ||
+        (!options.config.bme && !options.config.ds18))
+    {
+        usage();
+    }
+    
+    // A connection per node at once, on both sides of loopback
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    
+    // Faults given on the command line replace the scenario's own. Their outage times are in seconds.
+    FaultConfig customEmonFaults;
+    FaultConfig customProvisioningFaults;
+    
+    if (!customEmonFaults.parse(options.emonFaults) || !customProvisioningFaults.parse(options.provisioningFaults)) {
+        usage();
+    }
+    
+    if (options.scenarios.empty()) {
+        options.scenarios.push_back((options.emonFaults.empty() && options.provisioningFaults.empty()) ? "healthy" : "custom");
+    }
+    
+    std::vector<ScenarioResult> results;
+    
+    for (size_t s = 0; s < options.scenarios.size(); s++)
+    {
+        const std::string &wanted = options.scenarios[s];
+        
+        for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+        {
+            const Scenario &scenario = scenarios[i];
+            
+            // "custom" is the healthy scenario plus the command line faults
+            if (wanted != "all" && wanted != scenario.name && !(wanted == "custom" && i == 0)) {
+                continue;
+            }
+            
+            FaultConfig emonFaults = options.emonFaults.empty() ? scaledFaults(scenario.emonFaults, options.seconds) : customEmonFaults;
+            FaultConfig provisioningFaults = options.provisioningFaults.empty() ? scaledFaults(scenario.provisioningFaults, options.seconds) : customProvisioningFaults;
+            
+            ScenarioResult result;
+            if (!runScenario(options, wanted == "custom" ? wanted : scenario.name, emonFaults, provisioningFaults, result)) {
+                return 1;
+            }
+            
+            printReport(result);
+            results.push_back(result);
+        }
+    }
+    
+    if (results.empty()) {
+        usage();
+    }
+    
+    if (results.size() > 1) {
+        printSummary(results);
+    }
+    
+    return 0;
+}
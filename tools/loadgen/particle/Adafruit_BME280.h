@@ -0,0 +1,47 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Host stand-in for the Adafruit BME280 library: readings wander slowly around SimDevice::baseTemp
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef adafruit_bme280_h
+#define adafruit_bme280_h
+
+#include "Particle.h"
+
+class Adafruit_BME280
+{
+    public:
+        bool begin(void) { return simDevice.bmeFitted; }
+        
+        float readTemperature(void) { return simDevice.baseTemp + 2.0 * sin(millis() / 600000.0); }
+        float readPressure(void) { return 101325.0 + 500.0 * sin(millis() / 3600000.0); }     // Pa
+        float readHumidity(void) { return 50.0 + 10.0 * sin(millis() / 1800000.0); }
+};
+
+#endif
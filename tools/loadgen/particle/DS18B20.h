@@ -0,0 +1,48 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Host stand-in for the DS18B20 library: readings wander slowly around SimDevice::baseTemp
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ds18b20_h
+#define ds18b20_h
+
+#include "Particle.h"
+
+class DS18B20
+{
+    public:
+        DS18B20(uint16_t pin, bool singleDrop = false) { (void)pin; (void)singleDrop; }
+        
+        bool search(void) { return simDevice.ds18Fitted; }
+        
+        float getTemperature(void) { return simDevice.baseTemp - 8.0 + 4.0 * sin(millis() / 900000.0); }
+        bool crcCheck(void) { return true; }
+};
+
+#endif
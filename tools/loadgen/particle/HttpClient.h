@@ -0,0 +1,72 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Host stand-in for the Particle HttpClient library
+ * Like the real one: HTTP/1.0, a new connection per request, read until the server closes or goes quiet for 5 seconds
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef httpclient_h
+#define httpclient_h
+
+#include "Particle.h"
+
+#define HTTP_TIMEOUT_MS 5000
+
+typedef struct
+{
+    const char *header;
+    const char *value;
+} http_header_t;
+
+typedef struct
+{
+    String hostname;
+    IPAddress ip;
+    String path;
+    int port;
+    String body;
+} http_request_t;
+
+typedef struct
+{
+    int status;
+    String body;
+} http_response_t;
+
+class HttpClient
+{
+    public:
+        void get(http_request_t &request, http_response_t &response, http_header_t headers[]) { this->request(request, response, headers, "GET"); }
+        void post(http_request_t &request, http_response_t &response, http_header_t headers[]) { this->request(request, response, headers, "POST"); }
+        
+    private:
+    
+        void request(http_request_t &request, http_response_t &response, http_header_t headers[], const char *method);
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Host stand-in for the JsonParserGeneratorRK library: the writer calls, and flat object lookups, that EmonLink uses
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef jsonparsergeneratorrk_h
+#define jsonparsergeneratorrk_h
+
+#include "Particle.h"
+
+class JsonWriter
+{
+    public:
+        JsonWriter(char *buffer, size_t bufferLen) : _buffer(buffer), _bufferLen(bufferLen), _first(true) { _buffer[0] = '\0'; }
+        
+        void startObject(void) { append("{"); _first = true; }
+        void finishObjectOrArray(void) { append("}"); _first = false; }
+        
+        // Values are written as strings, as the real library does for const char *
+        void insertKeyValue(const char *key, const char *value)
+        {
+            if (!_first) {
+                append(",");
+            }
+            append("\""); append(key); append("\":\""); append(value); append("\"");
+            _first = false;
+        }
+        
+        const char *getBuffer(void) const { return _buffer; }
+        
+    private:
+    
+        void append(const char *text) { strncat(_buffer, text, _bufferLen - strlen(_buffer) - 1); }
+        
+        char *_buffer;
+        size_t _bufferLen;
+        bool _first;
+};
+
+template <size_t BUFFER_SIZE>
+class JsonWriterStatic : public JsonWriter
+{
+    public:
+        JsonWriterStatic(void) : JsonWriter(_staticBuffer, BUFFER_SIZE) {}
+        
+    private:
+        char _staticBuffer[BUFFER_SIZE];
+};
+
+class JsonWriterAutoObject
+{
+    public:
+        JsonWriterAutoObject(JsonWriter *writer) : _writer(writer) { _writer->startObject(); }
+        ~JsonWriterAutoObject(void) { _writer->finishObjectOrArray(); }
+        
+    private:
+        JsonWriter *_writer;
+};
+
+class JsonParser
+{
+    public:
+        void clear(void) { _text.clear(); }
+        void addString(const char *text) { _text += text; }
+        void addString(const String &text) { _text += text; }
+        
+        // Only checks it looks like an object: the lookups below do the rest
+        bool parse(void);
+        
+        bool getOuterValueByKey(const char *name, String &result) const;
+        bool getOuterValueByKey(const char *name, int &result) const;
+        
+    private:
+        std::string _text;
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Host stand-ins for the Particle Device OS API, just enough to build EmonLink and EnvNode for emon-loadgen
+ * Each simulated node runs in its own process, so, like on a Photon, the firmware's globals are per node
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef particle_h
+#define particle_h
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "SimDevice.h"
+
+// Wiring String, on top of std::string
+class String : public std::string
+{
+    public:
+        String(void) {}
+        String(const char *value) : std::string(value ? value : "") {}
+        String(const std::string &value) : std::string(value) {}
+        
+        static String format(const char *format, ...) __attribute__((format(printf, 1, 2)))
+        {
+            char buffer[1024];
+            va_list args;
+            
+            va_start(args, format);
+            vsnprintf(buffer, sizeof(buffer), format, args);
+            va_end(args);
+            return String(buffer);
+        }
+        
+        bool equals(const String &other) const { return compare(other) == 0; }
+        bool concat(const String &other) { append(other); return true; }
+};
+
+#define PRIVATE 1
+#define PUBLIC  0
+
+// Pins only matter to the sensor stand-ins, which ignore them
+#define D6 6
+#define TX 20
+
+class SystemClass
+{
+    public:
+        String deviceID(void) { return String(simDevice.deviceId); }
+        uint32_t ticks(void);
+};
+extern SystemClass System;
+
+// Events go nowhere: we count them, for the load report (a real device is held to about one a second)
+class ParticleClass
+{
+    public:
+        bool publish(const char *name, const char *data = NULL, int ttl = 60, int flags = PUBLIC)
+        {
+            (void)name; (void)data; (void)ttl; (void)flags;
+            simDevice.publishes++;
+            return true;
+        }
+        bool publish(const String &name, const String &data, int flags = PUBLIC) { return publish(name.c_str(), data.c_str(), 60, flags); }
+        bool publish(const char *name, const String &data, int flags = PUBLIC) { return publish(name, data.c_str(), 60, flags); }
+};
+extern ParticleClass Particle;
+
+uint32_t millis(void);
+void delay(uint32_t ms);
+uint32_t HAL_RNG_GetRandomNumber(void);
+
+class IPAddress
+{
+    public:
+        IPAddress(void) : _address(0) {}
+        IPAddress(uint32_t address) : _address(address) {}     // Network byte order
+        
+        explicit operator bool(void) const { return _address != 0; }
+        uint32_t raw(void) const { return _address; }
+        
+    private:
+        uint32_t _address;
+};
+
+class WiFiClass
+{
+    public:
+        IPAddress resolve(const String &host);
+};
+extern WiFiClass WiFi;
+
+// A real UDP socket. The local port is ignored: every simulated node shares the host's ports,
+// so each gets an ephemeral one, which is where replies come back to.
+class UDP
+{
+    public:
+        UDP(void) : _fd(-1), _available(0), _readPos(0) {}
+        ~UDP(void) { stop(); }
+        
+        uint8_t begin(uint16_t port);
+        void stop(void);
+        int sendPacket(const uint8_t *buffer, size_t size, IPAddress ip, uint16_t port);
+        
+        // Size of the next datagram waiting, 0 if none: read() then returns its bytes
+        int parsePacket(void);
+        int read(uint8_t *buffer, size_t size);
+        
+    private:
+        int _fd;
+        uint8_t _buffer[512];
+        size_t _available;
+        size_t _readPos;
+};
+
+#endif
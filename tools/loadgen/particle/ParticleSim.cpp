@@ -0,0 +1,283 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Host stand-ins for the Particle Device OS API and libraries used by EmonLink and EnvNode
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Particle.h"
+#include "HttpClient.h"
+#include "JsonParserGeneratorRK.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <random>
+
+#include "Http.h"
+
+SimDevice simDevice;
+SystemClass System;
+ParticleClass Particle;
+WiFiClass WiFi;
+
+static uint64_t monotonicUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Time since the load generator started: the nodes are forked from it
+static const uint64_t bootUs = monotonicUs();
+
+uint32_t millis(void)
+{
+    return (monotonicUs() - bootUs) / 1000;
+}
+
+void delay(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+// Stands in for the cycle counter: microseconds, so only differences mean anything
+uint32_t SystemClass::ticks(void)
+{
+    return monotonicUs();
+}
+
+uint32_t HAL_RNG_GetRandomNumber(void)
+{
+    static std::random_device device;
+    return device();
+}
+
+IPAddress WiFiClass::resolve(const String &host)
+{
+    struct addrinfo hints;
+    struct addrinfo *address = NULL;
+    
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    
+    if (getaddrinfo(host.c_str(), NULL, &hints, &address) != 0 || address == NULL) {
+        return IPAddress();
+    }
+    
+    IPAddress ip(((struct sockaddr_in *)address->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(address);
+    return ip;
+}
+
+uint8_t UDP::begin(uint16_t)
+{
+    stop();
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+    return _fd >= 0;
+}
+
+void UDP::stop(void)
+{
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+int UDP::sendPacket(const uint8_t *buffer, size_t size, IPAddress ip, uint16_t port)
+{
+    struct sockaddr_in address;
+    
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = ip.raw();
+    
+    return sendto(_fd, buffer, size, 0, (struct sockaddr *)&address, sizeof(address));
+}
+
+int UDP::parsePacket(void)
+{
+    _available = 0;
+    _readPos = 0;
+    
+    if (_fd < 0) {
+        return 0;
+    }
+    
+    ssize_t len = recv(_fd, _buffer, sizeof(_buffer), MSG_DONTWAIT);
+    if (len > 0) {
+        _available = len;
+    }
+    return _available;
+}
+
+int UDP::read(uint8_t *buffer, size_t size)
+{
+    size_t len = std::min(size, _available - _readPos);
+    
+    memcpy(buffer, _buffer + _readPos, len);
+    _readPos += len;
+    return len;
+}
+
+static bool waitFor(int fd, short events, int timeoutMs)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeoutMs);
+    } while (ready < 0 && errno == EINTR);
+    
+    return ready == 1;
+}
+
+void HttpClient::request(http_request_t &request, http_response_t &response, http_header_t headers[], const char *method)
+{
+    response.status = -1;
+    response.body = "";
+    
+    IPAddress ip = WiFi.resolve(request.hostname);
+    if (!ip) {
+        return;
+    }
+    
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(simDevice.mapPort(request.port));
+    address.sin_addr.s_addr = ip.raw();
+    
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        return;
+    }
+    
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+    
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0 &&
+        (errno != EINPROGRESS || !waitFor(fd, POLLOUT, HTTP_TIMEOUT_MS) ||
+         getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) != 0 || error != 0))
+    {
+        close(fd);
+        return;
+    }
+    
+    std::string message = std::string(method) + " " + request.path + " HTTP/1.0\r\n";
+    message += "Connection: close\r\n";
+    message += "HOST: " + request.hostname + "\r\n";
+    for (int i = 0; headers != NULL && headers[i].header != NULL; i++) {
+        message += std::string(headers[i].header) + ": " + (headers[i].value ? headers[i].value : "") + "\r\n";
+    }
+    if (!request.body.empty()) {
+        message += "Content-Length: " + std::to_string(request.body.size()) + "\r\n";
+    }
+    message += "\r\n";
+    message += request.body;
+    
+    size_t sent = 0;
+    while (sent < message.size())
+    {
+        ssize_t n = send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EAGAIN && waitFor(fd, POLLOUT, HTTP_TIMEOUT_MS)) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            return;
+        }
+        sent += n;
+    }
+    
+    // Read until the server closes, or nothing arrives for the timeout
+    std::string received;
+    char chunk[4096];
+    
+    while (waitFor(fd, POLLIN, HTTP_TIMEOUT_MS))
+    {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            break;
+        }
+        received.append(chunk, n);
+    }
+    close(fd);
+    
+    // HTTP/1.x NNN ...
+    if (received.compare(0, 5, "HTTP/") != 0 || received.find(' ') == std::string::npos) {
+        return;
+    }
+    response.status = atoi(received.c_str() + received.find(' ') + 1);
+    
+    size_t bodyStart = received.find("\r\n\r\n");
+    if (bodyStart != std::string::npos) {
+        response.body = received.substr(bodyStart + 4);
+    }
+}
+
+bool JsonParser::parse(void)
+{
+    size_t first = _text.find_first_not_of(" \t\r\n");
+    size_t last = _text.find_last_not_of(" \t\r\n");
+    
+    return first != std::string::npos && _text[first] == '{' && _text[last] == '}';
+}
+
+bool JsonParser::getOuterValueByKey(const char *name, String &result) const
+{
+    std::string value;
+    
+    if (!jsonValue(_text, name, value)) {
+        return false;
+    }
+    result = value;
+    return true;
+}
+
+bool JsonParser::getOuterValueByKey(const char *name, int &result) const
+{
+    std::string value;
+    
+    if (!jsonValue(_text, name, value)) {
+        return false;
+    }
+    result = atoi(value.c_str());
+    return true;
+}
@@ -0,0 +1,62 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Controls for the simulated Photon that the Particle stand-ins act out. emon-loadgen sets these in each node's process before it starts.
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef simdevice_h
+#define simdevice_h
+
+#include <map>
+#include <string>
+
+struct SimDevice
+{
+    SimDevice(void) : bmeFitted(true), ds18Fitted(true), baseTemp(20.0), publishes(0) {}
+    
+    std::string deviceId;
+    
+    bool bmeFitted;
+    bool ds18Fitted;
+    double baseTemp;            // Readings wander around this
+    
+    long publishes;
+    
+    // The firmware talks to fixed ports on the emonpi (80, 5000). The mocks listen wherever they can, so map them.
+    std::map<int, int> portMap;
+    
+    int mapPort(int port) const
+    {
+        std::map<int, int>::const_iterator it = portMap.find(port);
+        return it == portMap.end() ? port : it->second;
+    }
+};
+
+extern SimDevice simDevice;
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * emon-standin: stands in for emonCMS and the provisioning service, for testing on loopback
+ * It answers node lookups from a nodes file, accepts /input/post and /input/bulk, and prints every input it gets
+ *
+ * Usage: emon-standin [--listen ADDR] [--port N] [--nodes FILE] [--collector HOST[:PORT]]
+ *                     [--faults SPEC] [--provisioning-faults SPEC]
+ *
+ * The nodes file has a line per node: <device id> <emon name> <api key>
+ * Fault specs are like latency=200,jitter=100,errors=0.05,drops=0.01,outage=60-90 (see MockEmon.h)
+ * The one port follows --faults outages: refused with outage=, hung with hang=
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "EnvPacket.h"
+#include "HttpServer.h"
+#include "MockEmon.h"
+
+static MockEmon mock;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stopHandler(int)
+{
+    stopping = 1;
+}
+
+static void handle(const HttpRequest &request, HttpResponse &response)
+{
+    mock.handle(request, response);
+}
+
+static HttpAdmission admit(void)
+{
+    return mock.emonAdmission();
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: emon-standin [--listen ADDR] [--port N] [--nodes FILE] [--collector HOST[:PORT]]\n"
+                    "                    [--faults SPEC] [--provisioning-faults SPEC]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    std::string listenAddress = "127.0.0.1";
+    int port = 8080;
+    
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        
+        if (i + 1 >= argc) {
+            usage();
+        }
+        std::string value = argv[++i];
+        
+        if (arg == "--listen") {
+            listenAddress = value;
+        } else if (arg == "--port") {
+            port = atoi(value.c_str());
+        } else if (arg == "--nodes") {
+            if (!mock.loadNodes(value.c_str())) {
+                fprintf(stderr, "Can't read %s\n", value.c_str());
+                return 1;
+            }
+        } else if (arg == "--collector") {
+            std::string collectorHost;
+            int collectorPort = ENVPACKET_COLLECTOR_PORT;
+            splitHostPort(value, collectorHost, collectorPort);
+            mock.setCollector(collectorHost, collectorPort);
+        } else if (arg == "--faults" || arg == "--provisioning-faults") {
+            FaultConfig faults;
+            if (!faults.parse(value)) {
+                usage();
+            }
+            if (arg == "--faults") {
+                mock.setEmonFaults(faults);
+            } else {
+                mock.setProvisioningFaults(faults);
+            }
+        } else {
+            usage();
+        }
+    }
+    
+    mock.setPrintInputs(true);
+    mock.start();
+    
+    HttpServer server(handle);
+    server.setAdmission(admit);
+    
+    if (!server.listen(listenAddress, port))
+    {
+        fprintf(stderr, "Can't listen on %s:%d: %s\n", listenAddress.c_str(), port, strerror(errno));
+        return 1;
+    }
+    server.start();
+    
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+    
+    fprintf(stderr, "Standing in for emonCMS on %s:%d with %zu nodes\n", listenAddress.c_str(), server.port(), mock.nodeCount());
+    
+    while (!stopping) {
+        pause();
+    }
+    
+    server.stop();
+    
+    MockStats emon = mock.emonStats();
+    MockStats provisioning = mock.provisioningStats();
+    
+    fprintf(stderr, "connections %ld, requests %ld, left hanging %ld, inputs %ld, provisioned %ld\n", server.connectionsAccepted(), server.requestsServed(),
+            server.connectionsBlackholed(), emon.inputs, provisioning.inputs);
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Loopback check of HttpServer's admission modes, as the mock emonCMS uses them for outages: connections refused,
+ * then accepted but never answered, then served again on the same port. Exits non-zero if any check fails.
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "HttpConnection.h"
+#include "HttpServer.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// The accept thread looks at the admission every 100ms: give a change this long to show
+#define SETTLE_MS 2000
+
+// 0 if a connection was made (and closed again), otherwise why not
+static int tryConnect(int port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int result = (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) ? 0 : errno;
+    close(fd);
+    return result;
+}
+
+static long elapsedMs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Retry until connecting gives what we want, or we give up
+static bool waitForConnect(int port, int wanted)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    while (elapsedMs(start) < SETTLE_MS)
+    {
+        if (tryConnect(port) == wanted) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return false;
+}
+
+int main(void)
+{
+    std::atomic<int> admission(HTTP_ADMIT);
+    
+    HttpServer server([](const HttpRequest &, HttpResponse &response) { response.status = 200; response.body = "ok"; });
+    server.setAdmission([&admission](void) { return (HttpAdmission)admission.load(); });
+    
+    if (!server.listen("127.0.0.1", 0)) {
+        fprintf(stderr, "Can't listen\n");
+        return 1;
+    }
+    server.start();
+    int port = server.port();
+    
+    // Keep-alive connections opened while all is well, to see what happens to them later
+    HttpConnection before("127.0.0.1", port, 300);
+    HttpConnection hangingBefore("127.0.0.1", port, 300);
+    CHECK(before.get("/").status == 200);
+    CHECK(hangingBefore.get("/").status == 200);
+    
+    // Refused: nothing listening, so connecting fails straight away. An open connection is closed at its next request.
+    admission = HTTP_REFUSE;
+    CHECK(waitForConnect(port, ECONNREFUSED));
+    
+    long served = server.requestsServed();
+    CHECK(before.get("/").status == -1);
+    CHECK(HttpConnection("127.0.0.1", port, 300).get("/").status == -1);
+    CHECK(server.requestsServed() == served);
+    
+    // Hung: listening again, and connecting works, but no request is ever answered. Nor is one on an open connection.
+    admission = HTTP_BLACKHOLE;
+    CHECK(waitForConnect(port, 0));
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CHECK(HttpConnection("127.0.0.1", port, 300).get("/").status == -1);
+    CHECK(elapsedMs(start) >= 250);
+    
+    start = std::chrono::steady_clock::now();
+    CHECK(hangingBefore.get("/").status == -1);
+    CHECK(elapsedMs(start) >= 250);
+    
+    CHECK(server.requestsServed() == served);
+    CHECK(server.connectionsBlackholed() >= 2);
+    
+    // Recovered: served again, on the same port
+    admission = HTTP_ADMIT;
+    
+    bool recovered = false;
+    start = std::chrono::steady_clock::now();
+    while (!recovered && elapsedMs(start) < SETTLE_MS) {
+        recovered = (HttpConnection("127.0.0.1", port, 300).get("/").status == 200);
+    }
+    CHECK(recovered);
+    CHECK(server.port() == port);
+    CHECK(before.get("/").status == 200);
+    
+    // Straight from refusing to serving, too
+    admission = HTTP_REFUSE;
+    CHECK(waitForConnect(port, ECONNREFUSED));
+    admission = HTTP_ADMIT;
+    CHECK(waitForConnect(port, 0));
+    CHECK(HttpConnection("127.0.0.1", port, 300).get("/").status == 200);
+    
+    server.stop();
+    
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    
+    printf("All checks passed\n");
+    return 0;
+}
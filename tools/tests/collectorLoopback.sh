@@ -0,0 +1,186 @@
+#!/bin/sh
+#
+# Host-side tools for the emoncms environment monitor nodes
+#
+# End to end check of the collector on loopback: emon-standin plays emonCMS and the provisioning service,
+# envsend plays the nodes. Sends repeated, out of order and restarted-node datagrams, plus one from an unknown
+# device, then checks the exact bulk inputs the stand-in got, the acks, and the collector's counts. Then flushes
+# often, to check every bulk post goes over one connection, and posts through an emonCMS outage, to check every
+# reading held meanwhile is posted once it's back, and only once.
+#
+# Usage: collectorLoopback.sh EMON-STANDIN EMON-COLLECTOR ENVSEND
+
+set -u
+
+STANDIN=$1
+COLLECTOR=$2
+ENVSEND=$3
+
+DIR=$(mktemp -d)
+STANDIN_PID=
+COLLECTOR_PID=
+
+cleanup()
+{
+    [ -n "$COLLECTOR_PID" ] && kill "$COLLECTOR_PID" 2>/dev/null
+    [ -n "$STANDIN_PID" ] && kill "$STANDIN_PID" 2>/dev/null
+    rm -rf "$DIR"
+}
+trap cleanup EXIT
+
+fail()
+{
+    echo "FAIL: $*" >&2
+    for log in "$DIR"/*.err; do
+        echo "--- $log" >&2
+        cat "$log" >&2
+    done
+    exit 1
+}
+
+# Both servers take a free port and say which on stderr: wait for the line, and pick the port out of it
+port_from()
+{
+    for i in $(seq 50); do
+        port=$(sed -n "s/^$2[^:]*:\([0-9][0-9]*\).*/\1/p" "$1" | head -n 1)
+        if [ -n "$port" ]; then
+            echo "$port"
+            return 0
+        fi
+        sleep 0.1
+    done
+    return 1
+}
+
+KITCHEN=0123456789abcdef01234567
+GARDEN=0123456789abcdef0123aaaa
+STRANGER=0123456789abcdef0123ffff
+
+cat > "$DIR/nodes.txt" <<NODES
+$KITCHEN kitchen-emon key1
+$GARDEN garden key1
+NODES
+
+# start CASE FAULTS COLLECTOR-OPTION...: a stand-in with those emonCMS faults (may be empty) and a collector
+# posting to it, logging to $DIR/CASE-*
+start()
+{
+    CASE=$1
+    FAULTS=$2
+    shift 2
+
+    "$STANDIN" --listen 127.0.0.1 --port 0 --nodes "$DIR/nodes.txt" ${FAULTS:+--faults "$FAULTS"} \
+        > "$DIR/$CASE-standin.out" 2> "$DIR/$CASE-standin.err" &
+    STANDIN_PID=$!
+    EMON_PORT=$(port_from "$DIR/$CASE-standin.err" "Standing in") || fail "emon-standin didn't start"
+
+    "$COLLECTOR" --listen 127.0.0.1 --port 0 --emon 127.0.0.1:$EMON_PORT --provisioning 127.0.0.1:$EMON_PORT \
+        "$@" 2> "$DIR/$CASE-collector.err" &
+    COLLECTOR_PID=$!
+    UDP_PORT=$(port_from "$DIR/$CASE-collector.err" "Listening on") || fail "emon-collector didn't start"
+}
+
+# Stops the collector, which flushes on the way out, then lets the stand-in finish printing and stops it too
+stop()
+{
+    kill -TERM $COLLECTOR_PID
+    wait $COLLECTOR_PID
+    COLLECTOR_PID=
+
+    sleep 0.2
+    kill -TERM $STANDIN_PID
+    wait $STANDIN_PID
+    STANDIN_PID=
+}
+
+send()
+{
+    "$ENVSEND" --to 127.0.0.1:$UDP_PORT --ack-wait 2000 "$@" >> "$DIR/$CASE-acks.out" 2>> "$DIR/$CASE-envsend.err"
+}
+
+# The values of the bulk inputs CASE's stand-in got, one per line, in order
+posted_values()
+{
+    sed -n 's/^bulk \[.*:\(-\{0,1\}[0-9.]*\)}\]$/\1/p' "$DIR/$1-standin.out"
+}
+
+# One flush, at exit: the bulk lines then come out in the order the collector accepted them
+start exact "" --flush-ms 60000 --batch 1000
+
+# kitchen: sent twice, then 3 before 2, then 3 again. Acks carry the highest sequence seen.
+send --id $KITCHEN --name kitchen --boot 1 --seq 1 --repeat 2 encTemp=21.5 || fail "no ack for kitchen 1"
+send --id $KITCHEN --name kitchen --boot 1 --seq 3 encTemp=23 humidity=48.5 || fail "no ack for kitchen 3"
+send --id $KITCHEN --name kitchen --boot 1 --seq 2 encTemp=22 || fail "no ack for kitchen 2"
+send --id $KITCHEN --name kitchen --boot 1 --seq 3 encTemp=23 humidity=48.5 || fail "no ack for kitchen 3 again"
+
+# garden doesn't know its cloud name: posted under the provisioning name. Sent three times.
+send --id $GARDEN --boot 9 --seq 7 --repeat 3 extTemp=-3.27 || fail "no ack for garden"
+
+# Unknown to the provisioning service: no ack, nothing posted
+send --id $STRANGER --name stranger --seq 1 encTemp=1 && fail "unknown device was acked"
+
+# kitchen restarts: new boot ID, sequence from 0 again
+send --id $KITCHEN --name kitchen --boot 2 --seq 0 pressure=1013.25 || fail "no ack for kitchen after restart"
+
+stop
+
+cat > "$DIR/acks.expected" <<EXPECTED
+ack boot 1 seq 1
+ack boot 1 seq 3
+ack boot 1 seq 3
+ack boot 1 seq 3
+ack boot 9 seq 7
+ack boot 2 seq 0
+EXPECTED
+
+# Offsets depend on timing: check everything else
+cat > "$DIR/bulk.expected" <<EXPECTED
+bulk [T,"kitchen",{"encTemp":21.50}]
+bulk [T,"kitchen",{"encTemp":23.00,"humidity":48.50}]
+bulk [T,"kitchen",{"encTemp":22.00}]
+bulk [T,"garden",{"extTemp":-3.27}]
+bulk [T,"kitchen",{"pressure":1013.25}]
+EXPECTED
+
+sed -n 's/^bulk \[-\{0,1\}[0-9][0-9]*,/bulk [T,/p' "$DIR/exact-standin.out" > "$DIR/bulk.out"
+
+diff -u "$DIR/acks.expected" "$DIR/exact-acks.out" || fail "acks differ"
+diff -u "$DIR/bulk.expected" "$DIR/bulk.out" || fail "bulk inputs differ"
+
+grep -q "^datagrams 10, malformed 0, duplicates 4, unknown 1, unresolved 0, queued 5, posted 5, dropped 0$" "$DIR/exact-collector.err" \
+    || fail "collector counts differ"
+grep -q "bulk posts 1 (0 failed, 0 readings rejected) over 1 emonCMS connections$" "$DIR/exact-collector.err" \
+    || fail "expected one bulk post"
+
+# Flushing every 200ms, readings 300ms apart: several bulk posts, all down the one connection
+start often "" --flush-ms 200
+for seq in 1 2 3 4 5 6; do
+    send --id $KITCHEN --name kitchen --boot 3 --seq $seq encTemp=$seq || fail "no ack for kitchen $seq when flushing often"
+    sleep 0.3
+done
+stop
+
+seq 6 > "$DIR/often.expected"
+posted_values often | sed 's/\.00$//' > "$DIR/often.out"
+diff -u "$DIR/often.expected" "$DIR/often.out" || fail "readings posted when flushing often differ"
+grep -Eq "bulk posts ([3-9]|[1-9][0-9]+) \(0 failed, 0 readings rejected\) over 1 emonCMS connections$" "$DIR/often-collector.err" \
+    || fail "expected several bulk posts over one connection"
+
+# emonCMS refuses connections from 1s to 2.5s in: what arrives meanwhile is held, and retried once it's back.
+# kitchen is looked up before then, so its readings are all acked.
+start outage "outage=1-2.5" --flush-ms 250
+for seq in $(seq 12); do
+    send --id $KITCHEN --name kitchen --boot 4 --seq $seq encTemp=$seq || fail "no ack for kitchen $seq in the outage"
+    sleep 0.25
+done
+sleep 0.5
+stop
+
+seq 12 > "$DIR/outage.expected"
+posted_values outage | sed 's/\.00$//' | sort -n > "$DIR/outage.out"
+diff -u "$DIR/outage.expected" "$DIR/outage.out" || fail "readings posted through the outage differ"
+grep -q "queued 12, posted 12, dropped 0$" "$DIR/outage-collector.err" || fail "collector counts through the outage differ"
+grep -Eq "bulk posts [0-9]+ \([1-9][0-9]* failed, 0 readings rejected\)" "$DIR/outage-collector.err" \
+    || fail "expected bulk posts to fail in the outage"
+
+echo "Collector loopback OK"
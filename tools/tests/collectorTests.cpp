@@ -0,0 +1,251 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Unit checks for the collector's pieces: the datagram codec shared with the firmware, the sequence window,
+ * and the JSON helpers. Prints each failed check, and exits non-zero if there were any.
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "EnvPacket.h"
+#include "Http.h"
+#include "SequenceWindow.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static void testSequenceWindow(void)
+{
+    SequenceWindow window;
+    
+    // First datagram from a node, and repeats of it
+    CHECK(window.accept(1, 100));
+    CHECK(!window.accept(1, 100));
+    
+    // Out of order: later first, then the gap filled in, once
+    CHECK(window.accept(1, 103));
+    CHECK(window.accept(1, 101));
+    CHECK(window.accept(1, 102));
+    CHECK(!window.accept(1, 101));
+    CHECK(!window.accept(1, 102));
+    CHECK(window.highest() == 103);
+    
+    // Within the window but never seen is still new; beyond it is too old to tell, so refused
+    CHECK(window.accept(1, 103 - 63));
+    CHECK(!window.accept(1, 103 - 64));
+    
+    // A jump of a whole window or more: what came before is forgotten, so new if still in the window
+    CHECK(window.accept(1, 300));
+    CHECK(window.accept(1, 299));
+    CHECK(!window.accept(1, 103));
+    
+    // A new boot ID starts again, even from a lower sequence number
+    CHECK(window.accept(2, 0));
+    CHECK(window.bootId() == 2);
+    CHECK(window.highest() == 0);
+    CHECK(!window.accept(2, 0));
+    CHECK(window.accept(2, 1));
+    
+    // ... and going back to the old boot ID is another restart, not a replay
+    CHECK(window.accept(1, 300));
+    CHECK(window.bootId() == 1);
+    
+    // Boot IDs are 32 bits: one that matches in its low 16 is still another boot
+    CHECK(window.accept(0x10001, 0));
+    CHECK(window.bootId() == 0x10001);
+    
+    // Sequence numbers wrap
+    SequenceWindow wrapping;
+    CHECK(wrapping.accept(7, 0xfffffffe));
+    CHECK(wrapping.accept(7, 0xffffffff));
+    CHECK(wrapping.accept(7, 1));
+    CHECK(wrapping.highest() == 1);
+    CHECK(wrapping.accept(7, 0));
+    CHECK(!wrapping.accept(7, 0xffffffff));
+    CHECK(!wrapping.accept(7, 0));
+    CHECK(wrapping.accept(7, 2));
+}
+
+static void testPacketCodec(void)
+{
+    EnvPacket packet;
+    EnvPacket decoded;
+    uint8_t buffer[ENVPACKET_MAX_LEN];
+    
+    memset(&packet, 0, sizeof(packet));
+    CHECK(envPacketParseDeviceId("0123456789ABCDEF01234567", packet.deviceId));
+    strcpy(packet.name, "kitchen");
+    packet.bootId = 0xdeadbeef;
+    packet.sequence = 0x01020304;
+    packet.count = 2;
+    packet.readings[0].key = envPacketKeyId("encTemp");
+    packet.readings[0].value = envPacketToFixed(21.5f);
+    packet.readings[1].key = envPacketKeyId("extTemp");
+    packet.readings[1].value = envPacketToFixed(-3.27f);
+    
+    size_t len = envPacketEncode(packet, buffer, sizeof(buffer));
+    CHECK(len == ENVPACKET_HEADER_LEN + 1 + 7 + 2 * ENVPACKET_READING_LEN);
+    CHECK(buffer[0] == 'E' && buffer[1] == 'N' && buffer[2] == ENVPACKET_VERSION && buffer[3] == 2);
+    
+    // Big endian on the wire
+    CHECK(buffer[16] == 0xde && buffer[17] == 0xad && buffer[18] == 0xbe && buffer[19] == 0xef);
+    CHECK(buffer[20] == 1 && buffer[21] == 2 && buffer[22] == 3 && buffer[23] == 4);
+    
+    CHECK(envPacketDecode(buffer, len, decoded));
+    CHECK(memcmp(decoded.deviceId, packet.deviceId, ENVPACKET_DEVICE_ID_LEN) == 0);
+    CHECK(strcmp(decoded.name, "kitchen") == 0);
+    CHECK(decoded.bootId == 0xdeadbeef);
+    CHECK(decoded.sequence == 0x01020304);
+    CHECK(decoded.count == 2);
+    CHECK(strcmp(envPacketKeyName(decoded.readings[0].key), "encTemp") == 0);
+    CHECK(decoded.readings[0].value == 2150);
+    CHECK(strcmp(envPacketKeyName(decoded.readings[1].key), "extTemp") == 0);
+    CHECK(decoded.readings[1].value == -327);
+    
+    char hex[2 * ENVPACKET_DEVICE_ID_LEN + 1];
+    envPacketFormatDeviceId(decoded.deviceId, hex);
+    CHECK(strcmp(hex, "0123456789abcdef01234567") == 0);
+    
+    // Anything short, long, or not ours is refused
+    CHECK(!envPacketDecode(buffer, len - 1, decoded));
+    CHECK(!envPacketDecode(buffer, ENVPACKET_HEADER_LEN, decoded));
+    buffer[len] = 0;
+    CHECK(!envPacketDecode(buffer, len + 1, decoded));
+    buffer[2] = ENVPACKET_VERSION + 1;
+    CHECK(!envPacketDecode(buffer, len, decoded));
+    buffer[2] = ENVPACKET_VERSION;
+    buffer[1] = 'A';
+    CHECK(!envPacketDecode(buffer, len, decoded));
+    buffer[1] = 'N';
+    buffer[3] = ENVPACKET_MAX_READINGS + 1;
+    CHECK(!envPacketDecode(buffer, len, decoded));
+    buffer[3] = 2;
+    buffer[24] = ENVPACKET_MAX_NAME_LEN + 1;
+    CHECK(!envPacketDecode(buffer, len, decoded));
+    
+    // A node that doesn't know its name yet sends none
+    packet.name[0] = '\0';
+    len = envPacketEncode(packet, buffer, sizeof(buffer));
+    CHECK(envPacketDecode(buffer, len, decoded));
+    CHECK(decoded.name[0] == '\0');
+    
+    // Encoding refuses what won't fit, or can't be sent
+    CHECK(envPacketEncode(packet, buffer, len - 1) == 0);
+    packet.count = ENVPACKET_MAX_READINGS + 1;
+    CHECK(envPacketEncode(packet, buffer, sizeof(buffer)) == 0);
+    
+    // Largest datagram: longest name, most readings
+    memset(packet.name, 'n', ENVPACKET_MAX_NAME_LEN);
+    packet.name[ENVPACKET_MAX_NAME_LEN] = '\0';
+    packet.count = ENVPACKET_MAX_READINGS;
+    CHECK(envPacketEncode(packet, buffer, sizeof(buffer)) == ENVPACKET_MAX_LEN);
+    CHECK(envPacketDecode(buffer, ENVPACKET_MAX_LEN, decoded));
+    CHECK(strlen(decoded.name) == ENVPACKET_MAX_NAME_LEN);
+    
+    // Device IDs are exactly 24 hex digits
+    uint8_t deviceId[ENVPACKET_DEVICE_ID_LEN];
+    CHECK(!envPacketParseDeviceId("0123456789abcdef0123456", deviceId));
+    CHECK(!envPacketParseDeviceId("0123456789abcdef012345678", deviceId));
+    CHECK(!envPacketParseDeviceId("0123456789abcdef0123456g", deviceId));
+}
+
+static void testReadings(void)
+{
+    // Hundredths, rounded to nearest either side of zero
+    CHECK(envPacketToFixed(1013.25f) == 101325);
+    CHECK(envPacketToFixed(0.004f) == 0);
+    CHECK(envPacketToFixed(0.006f) == 1);
+    CHECK(envPacketToFixed(-0.004f) == 0);
+    CHECK(envPacketToFixed(-0.006f) == -1);
+    CHECK(envPacketFromFixed(-327) == -3.27);
+    
+    for (uint8_t id = 0; id < envPacketNumKeys; id++) {
+        CHECK(envPacketKeyId(envPacketKeyName(id)) == id);
+    }
+    CHECK(envPacketKeyId("voltage") == ENVPACKET_KEY_UNKNOWN);
+    CHECK(envPacketKeyName(ENVPACKET_KEY_UNKNOWN) == NULL);
+}
+
+static void testAck(void)
+{
+    uint8_t buffer[ENVPACKET_ACK_LEN];
+    uint32_t bootId;
+    uint32_t sequence;
+    
+    CHECK(envPacketEncodeAck(0x12345678, 0xfffffffe, buffer, sizeof(buffer)) == ENVPACKET_ACK_LEN);
+    CHECK(envPacketDecodeAck(buffer, ENVPACKET_ACK_LEN, bootId, sequence));
+    CHECK(bootId == 0x12345678);
+    CHECK(sequence == 0xfffffffe);
+    
+    CHECK(envPacketEncodeAck(1, 1, buffer, ENVPACKET_ACK_LEN - 1) == 0);
+    CHECK(!envPacketDecodeAck(buffer, ENVPACKET_ACK_LEN - 1, bootId, sequence));
+    
+    // A reading datagram is not an ack
+    buffer[1] = 'N';
+    CHECK(!envPacketDecodeAck(buffer, ENVPACKET_ACK_LEN, bootId, sequence));
+}
+
+static void testJson(void)
+{
+    std::string value;
+    std::string name = "kit\"chen\\2";
+    std::string json = "{\"id\":\"abc\",\"name\":\"" + jsonEscape(name) + "\",\"collectorPort\":5005}";
+    
+    CHECK(jsonEscape(name) == "kit\\\"chen\\\\2");
+    CHECK(jsonEscape("a\nb") == "a\\u000ab");
+    
+    CHECK(jsonValue(json, "name", value) && value == name);
+    CHECK(jsonValue(json, "id", value) && value == "abc");
+    CHECK(jsonValue(json, "collectorPort", value) && value == "5005");
+    CHECK(!jsonValue(json, "apikey", value));
+}
+
+int main(void)
+{
+    testSequenceWindow();
+    testPacketCodec();
+    testReadings();
+    testAck();
+    testJson();
+    
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    
+    printf("All checks passed\n");
+    return 0;
+}
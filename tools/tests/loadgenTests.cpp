@@ -0,0 +1,180 @@
+/*
+ * Host-side tools for the emoncms environment monitor nodes
+ *
+ * Unit checks for the load generator's pieces: fault specs, the mock's outage modes, and the report's
+ * percentiles and synchrony measures. Prints each failed check, and exits non-zero if there were any.
+ *
+ * Liam Friel
+ *
+ * Copyright (c) 2020 Liam Friel
+ *
+ * Permission is hereby granted, free of charge, 
+ * to any person obtaining a copy of this software and 
+ * associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including 
+ * without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell 
+ * copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, 
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice 
+ * shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES 
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "LoadReport.h"
+#include "MockEmon.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static void testFaultSpecs(void)
+{
+    FaultConfig faults;
+    
+    CHECK(faults.parse("latency=200,jitter=100,errors=0.05,drops=0.01,outage=60-90,reset=100-110,hang=120-130.5"));
+    CHECK(faults.latencyMs == 200);
+    CHECK(faults.jitterMs == 100);
+    CHECK(faults.errorRate == 0.05);
+    CHECK(faults.dropRate == 0.01);
+    CHECK(faults.outages.size() == 3);
+    CHECK(faults.describe() == "latency 200+100ms errors 5% drops 1% down 60-90s resetting 100-110s hung 120-130.5s");
+    
+    // From the start of an outage up to, but not including, its end
+    CHECK(faults.outageAt(59.9) == NULL);
+    CHECK(faults.outageAt(60) != NULL && faults.outageAt(60)->mode == OUTAGE_REFUSE);
+    CHECK(faults.outageAt(89.9) != NULL && faults.outageAt(89.9)->mode == OUTAGE_REFUSE);
+    CHECK(faults.outageAt(90) == NULL);
+    CHECK(faults.outageAt(105) != NULL && faults.outageAt(105)->mode == OUTAGE_RESET);
+    CHECK(faults.outageAt(130) != NULL && faults.outageAt(130)->mode == OUTAGE_HANG);
+    CHECK(faults.outageAt(130.5) == NULL);
+    
+    FaultConfig healthy;
+    CHECK(healthy.parse(""));
+    CHECK(healthy.describe() == "healthy");
+    CHECK(healthy.outageAt(0) == NULL);
+    
+    // Anything we don't understand is refused
+    FaultConfig bad;
+    CHECK(!bad.parse("latency"));
+    CHECK(!bad.parse("outage=60"));
+    CHECK(!bad.parse("hang=60"));
+    CHECK(!bad.parse("partition=1-2"));
+}
+
+static void testAdmission(void)
+{
+    const char *specs[] = { "", "outage=0-1000", "reset=0-1000", "hang=0-1000", "outage=1000-2000" };
+    HttpAdmission expected[] = { HTTP_ADMIT, HTTP_REFUSE, HTTP_ADMIT, HTTP_BLACKHOLE, HTTP_ADMIT };
+    
+    // Refused and hung outages are the server's to act out; a reset is answered (by dropping) in the handler
+    for (size_t i = 0; i < sizeof(specs) / sizeof(specs[0]); i++)
+    {
+        MockEmon mock;
+        FaultConfig faults;
+        
+        CHECK(faults.parse(specs[i]));
+        mock.setEmonFaults(faults);
+        mock.start();
+        
+        CHECK(mock.emonAdmission() == expected[i]);
+        CHECK(mock.provisioningAdmission() == HTTP_ADMIT);
+    }
+    
+    MockEmon mock;
+    FaultConfig faults;
+    faults.parse("hang=0-1000");
+    mock.setProvisioningFaults(faults);
+    mock.start();
+    CHECK(mock.provisioningAdmission() == HTTP_BLACKHOLE);
+    CHECK(mock.emonAdmission() == HTTP_ADMIT);
+}
+
+static void testPercentiles(void)
+{
+    std::vector<double> sorted;
+    
+    CHECK(percentile(sorted, 0.5) == 0);
+    
+    for (int i = 1; i <= 100; i++) {
+        sorted.push_back(i);
+    }
+    
+    CHECK(percentile(sorted, 0) == 1);
+    CHECK(percentile(sorted, 0.5) == 51);
+    CHECK(percentile(sorted, 0.9) == 91);
+    CHECK(percentile(sorted, 0.99) == 100);
+    CHECK(percentile(sorted, 1.0) == 100);
+    
+    sorted.assign(1, 42);
+    CHECK(percentile(sorted, 0.99) == 42);
+}
+
+static void testSynchrony(void)
+{
+    const int64_t period = 30000000;
+    std::vector<int64_t> starts;
+    
+    CHECK(synchrony(starts, period).count == 0);
+    CHECK(synchrony(starts, period).coherence == 0);
+    
+    // Lockstep: every node at the same point in its cycle, over several cycles
+    for (int i = 0; i < 100; i++) {
+        starts.push_back((i % 5) * period + 1234567);
+    }
+    Synchrony lockstep = synchrony(starts, period);
+    CHECK(lockstep.count == 100);
+    CHECK(lockstep.coherence > 0.999);
+    CHECK(lockstep.busiestTenth == 1.0);
+    
+    // Evenly spread over the period
+    starts.clear();
+    for (int i = 0; i < 100; i++) {
+        starts.push_back(i * period / 100);
+    }
+    Synchrony spread = synchrony(starts, period);
+    CHECK(spread.coherence < 0.01);
+    CHECK(spread.busiestTenth > 0.099 && spread.busiestTenth < 0.101);
+    
+    // Half at one phase, half opposite: they cancel out, though every start is in one of two tenths
+    starts.clear();
+    for (int i = 0; i < 100; i++) {
+        starts.push_back((i % 2) * period / 2);
+    }
+    Synchrony opposed = synchrony(starts, period);
+    CHECK(opposed.coherence < 0.01);
+    CHECK(opposed.busiestTenth == 0.5);
+}
+
+int main(void)
+{
+    testFaultSpecs();
+    testAdmission();
+    testPercentiles();
+    testSynchrony();
+    
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    
+    printf("All checks passed\n");
+    return 0;
+}